@@ -0,0 +1,74 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Timing helpers shared by the benchmarks in this directory. Every benchmark
+ * is a single program, built from the root of the repository together with the
+ * sources in src, as described at the top of each file. Build with -O2 and
+ * without sanitizers when comparing numbers. */
+
+#ifndef CORTO_BENCH_H
+#define CORTO_BENCH_H
+
+#include <corto/platform.h>
+#include <time.h>
+
+/* Number of runs per measurement. The fastest run is reported, which filters
+ * out most interference from other processes. */
+#define BENCH_REPEAT (7)
+
+/* Runs the benchmarked operation count times */
+typedef void (*bench_cb)(void *ctx, uint32_t count);
+
+/* Results are added to this variable, so that the compiler can't remove the
+ * benchmarked calls */
+static volatile uintptr_t bench_sink;
+
+static inline
+double bench_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Return the time of the fastest of BENCH_REPEAT runs in ns per operation */
+static inline
+double bench_run(
+    bench_cb action,
+    void *ctx,
+    uint32_t count)
+{
+    double best = 0;
+    int i;
+
+    for (i = 0; i < BENCH_REPEAT; i ++) {
+        double start = bench_now(), t;
+        action(ctx, count);
+        t = bench_now() - start;
+        if (!i || t < best) {
+            best = t;
+        }
+    }
+
+    return best / count;
+}
+
+#endif
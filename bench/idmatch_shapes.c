@@ -0,0 +1,186 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Benchmark of idmatch programs per pattern shape. Every shape that has a
+ * specialized kind is matched against a mix of ids, by the program that
+ * corto_idmatch_compile selects and by the original interpreter in
+ * test/idmatch_baseline.c. Compile times are measured for both as well.
+ *
+ * Build and run from the root of the repository:
+ *   cc -std=gnu99 -D_GNU_SOURCE -DBUILDING_CORTO=1 -O2 -Iinclude -Isrc \
+ *       bench/idmatch_shapes.c test/idmatch_baseline.c src/[a-z]*.c \
+ *       -lpthread -ldl -lm -o idmatch_shapes && ./idmatch_shapes
+ */
+
+#include "bench.h"
+#include "idmatch.h"
+
+typedef struct baseline_idmatch_program_s* baseline_idmatch_program;
+
+baseline_idmatch_program baseline_idmatch_compile(
+    const char *expr,
+    bool allowScopes,
+    bool allowSeparators);
+
+bool baseline_idmatch_run(
+    baseline_idmatch_program program,
+    const char *str);
+
+void baseline_idmatch_free(
+    baseline_idmatch_program matcher);
+
+/* Number of ids, must be a power of two */
+#define ID_COUNT (64)
+
+#define RUN_COUNT (400000)
+#define COMPILE_COUNT (20000)
+
+typedef struct shape {
+    const char *pattern;
+    corto_idmatch_program program;
+    baseline_idmatch_program baseline;
+} shape;
+
+static char ids[ID_COUNT][128];
+
+static
+void bench_baselineRun(
+    void *ctx,
+    uint32_t count)
+{
+    shape *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += baseline_idmatch_run(
+            s->baseline, ids[i & (ID_COUNT - 1)]);
+    }
+}
+
+static
+void bench_programRun(
+    void *ctx,
+    uint32_t count)
+{
+    shape *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += corto_idmatch_run(s->program, ids[i & (ID_COUNT - 1)]);
+    }
+}
+
+static
+void bench_baselineCompile(
+    void *ctx,
+    uint32_t count)
+{
+    shape *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        baseline_idmatch_free(
+            baseline_idmatch_compile(s->pattern, true, true));
+    }
+}
+
+static
+void bench_programCompile(
+    void *ctx,
+    uint32_t count)
+{
+    shape *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        corto_idmatch_free(corto_idmatch_compile(s->pattern, true, true));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char *elements[] = {
+        "data", "sensors", "temperature", "sensor", "sensor_tmp", "x_tmp",
+        "alpha", "zeta", "Config", "value", "s1"
+    };
+    static const char *patterns[] = {
+        "/data/sensors/temperature",
+        "data/sensors/*",
+        "data/sensors//*",
+        "sensor*",
+        "*_tmp",
+        "alpha,beta,gamma,delta,sensor,zeta,eta,theta",
+        "s0_da,s1_st,s2_vx,s3_da,s4_st,s5_vx,s6_da,s7_st,s8_vx,s9_da,"
+            "s10_st,s11_vx,s12_da,s13_st,sensor",
+        NULL
+    };
+    uint32_t i, p;
+    int errors = 0;
+
+    platform_init(argv[0]);
+    srand(35);
+
+    /* Half of the ids are in /data/sensors, a quarter are that scope itself */
+    for (i = 0; i < ID_COUNT; i ++) {
+        uint32_t n = 1 + rand() % 4, e;
+        ids[i][0] = '\0';
+        if (i % 4 == 0) {
+            strcpy(ids[i], "/data/sensors");
+        } else if (i % 4 == 1) {
+            strcpy(ids[i], "/data/sensors");
+            n = 0;
+        }
+        for (e = 0; e < n; e ++) {
+            strcat(ids[i], "/");
+            strcat(ids[i], elements[rand() % 11]);
+        }
+    }
+    strcpy(ids[2], "/data/sensors/temperature");
+
+    printf("%-46s %-4s %10s %10s %12s %12s\n", "pattern", "kind",
+        "original", "now", "compile", "now");
+
+    for (p = 0; patterns[p]; p ++) {
+        shape s = {
+            .pattern = patterns[p],
+            .program = corto_idmatch_compile(patterns[p], true, true),
+            .baseline = baseline_idmatch_compile(patterns[p], true, true)
+        };
+        double run, baselineRun, compile, baselineCompile;
+
+        if (!s.program || !s.baseline) {
+            printf("'%s' doesn't compile\n", patterns[p]);
+            errors ++;
+            continue;
+        }
+
+        baselineRun = bench_run(bench_baselineRun, &s, RUN_COUNT);
+        run = bench_run(bench_programRun, &s, RUN_COUNT);
+        baselineCompile = bench_run(bench_baselineCompile, &s, COMPILE_COUNT);
+        compile = bench_run(bench_programCompile, &s, COMPILE_COUNT);
+
+        printf("%-46.46s %-4d %7.1f ns %7.1f ns %9.2f us %9.2f us\n",
+            patterns[p], s.program->kind, baselineRun, run,
+            baselineCompile / 1000, compile / 1000);
+
+        corto_idmatch_free(s.program);
+        baseline_idmatch_free(s.baseline);
+    }
+
+    platform_deinit();
+
+    return errors != 0;
+}
@@ -0,0 +1,173 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Benchmark of corto_matchParent against the byte loop it replaced. Parents
+ * are absolute ids of 2 to 10 elements. Every id is its parent with random
+ * case changes and two more elements, so the whole parent is compared. Add
+ * -DCORTO_NO_SIMD to measure the scalar kernel.
+ *
+ * Build and run from the root of the repository:
+ *   cc -std=gnu99 -D_GNU_SOURCE -DBUILDING_CORTO=1 -O2 -Iinclude -Isrc \
+ *       bench/match_parent.c src/[a-z]*.c \
+ *       -lpthread -ldl -lm -o match_parent && ./match_parent
+ */
+
+#include "bench.h"
+
+/* Number of parent/id pairs per size */
+#define PAIR_COUNT (1024)
+
+#define COUNT (200000)
+
+typedef struct pairs {
+    char parents[PAIR_COUNT][512];
+    char ids[PAIR_COUNT][1024];
+} pairs;
+
+static
+const char* original_matchParent(
+    const char *parent,
+    const char *expr)
+{
+    const char *parentPtr = parent, *exprPtr = expr;
+    char parentCh, exprCh;
+
+    if (!parent) {
+        return expr;
+    }
+
+    if (*parentPtr == '/') parentPtr++;
+    if (*exprPtr == '/') exprPtr++;
+
+    if (!*parentPtr) {
+        return exprPtr;
+    }
+
+    while ((parentCh = *parentPtr) &&
+           (exprCh = *exprPtr))
+    {
+        if (parentCh < 97) parentCh = tolower(parentCh);
+        if (exprCh < 97) exprCh = tolower(exprCh);
+
+        if (parentCh != exprCh) {
+            break;
+        }
+
+        parentPtr++;
+        exprPtr++;
+    }
+
+    if (*parentPtr == '\0') {
+        if (*exprPtr == '/') {
+            exprPtr ++;
+        } else if (*exprPtr == '\0') {
+            exprPtr = ".";
+        } else {
+            exprPtr = NULL;
+        }
+        return exprPtr;
+    } else {
+        return NULL;
+    }
+}
+
+static
+void bench_originalMatchParent(
+    void *ctx,
+    uint32_t count)
+{
+    pairs *p = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        uint32_t pair = i & (PAIR_COUNT - 1);
+        bench_sink += (uintptr_t)original_matchParent(
+            p->parents[pair], p->ids[pair]);
+    }
+}
+
+static
+void bench_matchParent(
+    void *ctx,
+    uint32_t count)
+{
+    pairs *p = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        uint32_t pair = i & (PAIR_COUNT - 1);
+        bench_sink += (uintptr_t)corto_matchParent(
+            p->parents[pair], p->ids[pair]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char chars[] = "abcdefghijkLMNOPQ_0123";
+    static pairs p;
+    uint32_t sizes[][2] = {{2, 6}, {4, 10}, {6, 16}, {10, 24}}, s, i, e, c;
+    int errors = 0;
+
+    platform_init(argv[0]);
+    srand(40);
+
+    printf("%-8s %-8s %10s %10s\n", "elements", "length", "original", "now");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s ++) {
+        uint32_t elements = sizes[s][0], elementLength = sizes[s][1];
+        size_t total = 0;
+        double original, now;
+
+        for (i = 0; i < PAIR_COUNT; i ++) {
+            char *parent = p.parents[i], *ptr = parent;
+            for (e = 0; e < elements; e ++) {
+                *(ptr ++) = '/';
+                for (c = 0; c < elementLength; c ++) {
+                    *(ptr ++) = chars[rand() % (sizeof(chars) - 1)];
+                }
+            }
+            *ptr = '\0';
+            total += ptr - parent;
+
+            strcpy(p.ids[i], parent);
+            for (ptr = p.ids[i]; *ptr; ptr ++) {
+                if (isalpha(*ptr) && !(rand() % 4)) {
+                    *ptr ^= 0x20;
+                }
+            }
+            strcat(p.ids[i], "/child/leaf");
+
+            if (original_matchParent(parent, p.ids[i]) !=
+                corto_matchParent(parent, p.ids[i]))
+            {
+                printf("RESULT MISMATCH '%s' '%s'\n", parent, p.ids[i]);
+                errors ++;
+            }
+        }
+
+        original = bench_run(bench_originalMatchParent, &p, COUNT);
+        now = bench_run(bench_matchParent, &p, COUNT);
+
+        printf("%-8u %-8zu %7.1f ns %7.1f ns\n",
+            elements, total / PAIR_COUNT, original, now);
+    }
+
+    platform_deinit();
+
+    return errors != 0;
+}
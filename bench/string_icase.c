@@ -0,0 +1,243 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Benchmark of the case-insensitive string functions against the byte loops
+ * they replaced. Strings are equal except for case, so that every function
+ * scans the whole string. Add -DCORTO_NO_SIMD to measure the scalar kernels.
+ *
+ * Build and run from the root of the repository:
+ *   cc -std=gnu99 -D_GNU_SOURCE -DBUILDING_CORTO=1 -O2 -Iinclude -Isrc \
+ *       bench/string_icase.c src/[a-z]*.c \
+ *       -lpthread -ldl -lm -o string_icase && ./string_icase
+ */
+
+#include "bench.h"
+
+/* Operations per run, for strings of 8 characters. Longer strings get
+ * proportionally fewer operations. */
+#define COUNT (4000000)
+
+typedef struct strings {
+    char *str1;
+    char *str2;
+    char *buffer;
+    uint32_t length;
+} strings;
+
+static
+int original_stricmp(
+    const char *str1,
+    const char *str2)
+{
+    const char *ptr1, *ptr2;
+    char ch1, ch2;
+    ptr1 = str1;
+    ptr2 = str2;
+
+    while((ch1 = *ptr1) && (ch2 = *ptr2)) {
+        if (ch1 == ch2) {
+            ptr1++; ptr2++;
+            continue;
+        }
+        if (ch1 < 97) ch1 = tolower(ch1);
+        if (ch2 < 97) ch2 = tolower(ch2);
+        if (ch1 != ch2) {
+            return ch1 - ch2;
+        }
+        ptr1++;
+        ptr2++;
+    }
+
+    return tolower(*ptr1) - tolower(*ptr2);
+}
+
+static
+int original_strnicmp(
+    const char *str1,
+    int length,
+    const char *str2)
+{
+    const char *ptr1, *ptr2;
+    char ch1, ch2;
+    ptr1 = str1;
+    ptr2 = str2;
+
+    while((ch1 = *ptr1) && (ch2 = *ptr2)) {
+        if (ptr1 - str1 >= (length - 1)) break;
+        if (ch1 == ch2) {
+            ptr1++; ptr2++;
+            continue;
+        }
+        if (ch1 < 97) ch1 = tolower(ch1);
+        if (ch2 < 97) ch2 = tolower(ch2);
+        if (ch1 != ch2) {
+            return ch1 - ch2;
+        }
+        ptr1++;
+        ptr2++;
+    }
+
+    return tolower(*ptr1) - tolower(*ptr2);
+}
+
+static
+char* original_strlower(
+    char *str)
+{
+    char *ptr, ch;
+    ptr = str;
+    while ((ch = *ptr)) {
+        if (ch < 97) *ptr = tolower(ch);
+        ptr++;
+    }
+    return str;
+}
+
+static
+void bench_originalStricmp(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += original_stricmp(s->str1, s->str2);
+    }
+}
+
+static
+void bench_stricmp(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += stricmp(s->str1, s->str2);
+    }
+}
+
+static
+void bench_originalStrnicmp(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += original_strnicmp(s->str1, s->length, s->str2);
+    }
+}
+
+static
+void bench_strnicmp(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        bench_sink += strnicmp(s->str1, s->length, s->str2);
+    }
+}
+
+/* The string is copied before every conversion so that each run converts
+ * upper case characters. The copy is included in the time. */
+static
+void bench_originalStrlower(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        memcpy(s->buffer, s->str2, s->length + 1);
+        bench_sink += original_strlower(s->buffer)[0];
+    }
+}
+
+static
+void bench_strlower(
+    void *ctx,
+    uint32_t count)
+{
+    strings *s = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        memcpy(s->buffer, s->str2, s->length + 1);
+        bench_sink += strlower(s->buffer)[0];
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789_/";
+    uint32_t lengths[] = {8, 24, 64, 256}, l, i;
+    int errors = 0;
+
+    platform_init(argv[0]);
+    srand(26);
+
+    printf("%-8s %12s %12s %12s %12s %12s %12s\n", "length",
+        "stricmp", "now", "strnicmp", "now", "strlower", "now");
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l ++) {
+        uint32_t length = lengths[l], count = COUNT / (length / 8);
+        strings s = {
+            .str1 = corto_alloc(length + 1),
+            .str2 = corto_alloc(length + 1),
+            .buffer = corto_alloc(length + 1),
+            .length = length
+        };
+        double t[6];
+
+        for (i = 0; i < length; i ++) {
+            s.str1[i] = chars[rand() % (sizeof(chars) - 1)];
+            s.str2[i] = toupper(s.str1[i]);
+        }
+        s.str1[length] = s.str2[length] = '\0';
+
+        if (original_stricmp(s.str1, s.str2) != stricmp(s.str1, s.str2) ||
+            original_strnicmp(s.str1, length, s.str2) !=
+                strnicmp(s.str1, length, s.str2))
+        {
+            printf("RESULT MISMATCH for length %u\n", length);
+            errors ++;
+        }
+
+        t[0] = bench_run(bench_originalStricmp, &s, count);
+        t[1] = bench_run(bench_stricmp, &s, count);
+        t[2] = bench_run(bench_originalStrnicmp, &s, count);
+        t[3] = bench_run(bench_strnicmp, &s, count);
+        t[4] = bench_run(bench_originalStrlower, &s, count);
+        t[5] = bench_run(bench_strlower, &s, count);
+
+        printf("%-8u %9.1f ns %9.1f ns %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n",
+            length, t[0], t[1], t[2], t[3], t[4], t[5]);
+
+        corto_dealloc(s.str1);
+        corto_dealloc(s.str2);
+        corto_dealloc(s.buffer);
+    }
+
+    platform_deinit();
+
+    return errors != 0;
+}
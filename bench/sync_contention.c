@@ -0,0 +1,206 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Benchmark of semaphores and mutexes, without and with contention. Compare
+ * the default build with builds that add -DCORTO_NO_FUTEX (POSIX semaphores)
+ * or -DCORTO_MUTEX_ADAPTIVE (spinning mutexes).
+ *
+ * Build and run from the root of the repository:
+ *   cc -std=gnu99 -D_GNU_SOURCE -DBUILDING_CORTO=1 -O2 -Iinclude -Isrc \
+ *       bench/sync_contention.c src/[a-z]*.c \
+ *       -lpthread -ldl -lm -o sync_contention && ./sync_contention
+ */
+
+#include "bench.h"
+
+/* Number of threads that compete for a mutex */
+#define LOCK_THREADS (4)
+
+typedef struct context {
+    corto_sem ping;
+    corto_sem pong;
+    corto_mutex_s lock;
+    uint32_t count;
+    uint64_t value;
+} context;
+
+static
+void bench_semUncontended(
+    void *ctx,
+    uint32_t count)
+{
+    context *c = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        corto_sem_post(c->ping);
+        corto_sem_wait(c->ping);
+    }
+}
+
+static
+void* bench_ponger(
+    void *ctx)
+{
+    context *c = ctx;
+    uint32_t i;
+    for (i = 0; i < c->count; i ++) {
+        corto_sem_wait(c->ping);
+        corto_sem_post(c->pong);
+    }
+    return NULL;
+}
+
+/* Every operation wakes up the other thread, which is blocked */
+static
+void bench_semPingPong(
+    void *ctx,
+    uint32_t count)
+{
+    context *c = ctx;
+    corto_thread thread;
+    uint32_t i;
+
+    c->count = count;
+    thread = corto_thread_new(bench_ponger, c);
+    for (i = 0; i < count; i ++) {
+        corto_sem_post(c->ping);
+        corto_sem_wait(c->pong);
+    }
+    corto_thread_join(thread, NULL);
+}
+
+static
+void* bench_consumer(
+    void *ctx)
+{
+    context *c = ctx;
+    uint32_t i;
+    for (i = 0; i < c->count; i ++) {
+        corto_sem_wait(c->ping);
+    }
+    return NULL;
+}
+
+/* The consumer only blocks when it catches up with the producer */
+static
+void bench_semProducerConsumer(
+    void *ctx,
+    uint32_t count)
+{
+    context *c = ctx;
+    corto_thread thread;
+    uint32_t i;
+
+    c->count = count;
+    thread = corto_thread_new(bench_consumer, c);
+    for (i = 0; i < count; i ++) {
+        corto_sem_post(c->ping);
+    }
+    corto_thread_join(thread, NULL);
+}
+
+static
+void bench_mutexUncontended(
+    void *ctx,
+    uint32_t count)
+{
+    context *c = ctx;
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        corto_mutex_lock(&c->lock);
+        c->value ++;
+        corto_mutex_unlock(&c->lock);
+    }
+}
+
+static
+void* bench_locker(
+    void *ctx)
+{
+    context *c = ctx;
+    uint32_t i;
+    for (i = 0; i < c->count; i ++) {
+        corto_mutex_lock(&c->lock);
+        c->value ++;
+        corto_mutex_unlock(&c->lock);
+    }
+    return NULL;
+}
+
+static
+void bench_mutexContended(
+    void *ctx,
+    uint32_t count)
+{
+    context *c = ctx;
+    corto_thread threads[LOCK_THREADS];
+    uint32_t i;
+
+    c->count = count / LOCK_THREADS;
+    for (i = 0; i < LOCK_THREADS; i ++) {
+        threads[i] = corto_thread_new(bench_locker, c);
+    }
+    for (i = 0; i < LOCK_THREADS; i ++) {
+        corto_thread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    context c = {0};
+    uint64_t expected = 0;
+    int errors = 0;
+
+    platform_init(argv[0]);
+
+    c.ping = corto_sem_new(0);
+    c.pong = corto_sem_new(0);
+    corto_mutex_new(&c.lock);
+
+    printf("%-32s %10s\n", "operation", "time");
+    printf("%-32s %7.1f ns\n", "semaphore post+wait",
+        bench_run(bench_semUncontended, &c, 2000000));
+    printf("%-32s %7.1f ns\n", "semaphore ping-pong",
+        bench_run(bench_semPingPong, &c, 100000));
+    printf("%-32s %7.1f ns\n", "semaphore producer/consumer",
+        bench_run(bench_semProducerConsumer, &c, 250000));
+    printf("%-32s %7.1f ns\n", "mutex lock+unlock",
+        bench_run(bench_mutexUncontended, &c, 2000000));
+    expected += BENCH_REPEAT * 2000000ull;
+    printf("%-32s %7.1f ns\n", "mutex lock+unlock, 4 threads",
+        bench_run(bench_mutexContended, &c, 2000000));
+    expected += BENCH_REPEAT * 2000000ull;
+
+    /* Lost wakeups would have blocked, check for lost updates */
+    if (c.value != expected || corto_sem_value(c.ping) ||
+        corto_sem_value(c.pong))
+    {
+        printf("ERROR: inconsistent state after benchmark\n");
+        errors ++;
+    }
+
+    corto_sem_free(c.ping);
+    corto_sem_free(c.pong);
+    corto_mutex_free(&c.lock);
+
+    platform_deinit();
+
+    return errors != 0;
+}
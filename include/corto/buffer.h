@@ -96,6 +96,25 @@ CORTO_EXPORT bool corto_buffer_appendstrn(
     char *str,
     uint32_t n);
 
+/* Append string slice to buffer.
+ * Returns false when max is reached, true when there is still space */
+CORTO_EXPORT bool corto_buffer_appendview(
+    corto_buffer *buffer,
+    corto_strview str);
+
+/* Append escaped string to buffer (see chresc).
+ * Returns false when max is reached, true when there is still space */
+CORTO_EXPORT bool corto_buffer_appendesc(
+    corto_buffer *buffer,
+    const char *str,
+    char delimiter);
+
+/* Append unescaped string to buffer (see chrunesc).
+ * Returns false when max is reached, true when there is still space */
+CORTO_EXPORT bool corto_buffer_appendunesc(
+    corto_buffer *buffer,
+    const char *str);
+
 /* Return result string (also resets buffer) */
 CORTO_EXPORT char *corto_buffer_str(corto_buffer *buffer);
 
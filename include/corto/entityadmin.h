@@ -37,44 +37,151 @@ typedef struct corto_entity {
 
 CORTO_SEQUENCE(corto_entitySeq, corto_entity,);
 
+typedef
+int (*corto_entityBatchAction)(
+    corto_entity *entities,
+    uint32_t count,
+    void *userData);
+
 typedef struct corto_entityPerParent {
     corto_entitySeq entities;
-    char *parent;
+    const char *parent; /* Interned with corto_strinterni */
 } corto_entityPerParent;
 
 CORTO_SEQUENCE(corto_entityPerParentSeq, corto_entityPerParent,);
 
-/* Threads keep their own copy of active entities so there is no need for
- * a lock when walking the admin */
+typedef struct corto_entityAdmin_reader corto_entityAdmin_reader;
+typedef struct corto_entityAdmin_index corto_entityAdmin_index;
+typedef struct corto_entityAdmin_scope corto_entityAdmin_scope;
+typedef struct corto_entityAdmin_slot corto_entityAdmin_slot;
+
+/* Handle to an entity in the admin, obtained from corto_entityAdmin_add. A
+ * handle is not valid after its entity is removed. 0 is never a valid
+ * handle. */
+typedef uint64_t corto_entityHandle;
+
+/* Statistics of an admin, collected when collectStats is set */
+typedef struct corto_entityAdmin_stats_t {
+    uint64_t adds;          /* Entities added */
+    uint64_t removes;       /* Entities removed */
+    uint64_t snapshots;     /* Snapshots published */
+    uint64_t bytesCopied;   /* Bytes copied to publish snapshots */
+    uint64_t reclaimed;     /* Retired snapshots freed */
+    uint64_t locks;         /* Times the write lock was acquired */
+    uint64_t lockWait;      /* Nanoseconds spent waiting for the write lock */
+    uint64_t gets;          /* Calls to corto_entityAdmin_get */
+    uint64_t walks;         /* Walks, including batch walks */
+    uint64_t visited;       /* Entities passed to walk actions */
+} corto_entityAdmin_stats_t;
+
+/* Writers keep the entity administration in the admin. When a thread reads the
+ * admin after it changed, an immutable snapshot of it is published. A snapshot
+ * only copies the parents that changed, and shares everything else with the
+ * previous snapshot. Threads read the snapshot without locking or copying. A
+ * replaced snapshot is retired, and freed once no thread can still be reading
+ * it (epoch based reclamation). */
 typedef struct corto_entityAdmin {
-    /* Key for accessing local thread copy */
+    /* Key for accessing thread reader */
     corto_tls key;
 
     /* Total number of enitities */
     int count;
 
-    /* Lock for modifying /reading global object */
+    /* Lock for modifying global object */
     corto_rwmutex_s lock;
 
-    /* counter keeps track of when entities are added / removed so that
-     * threads know when to sync. */
+    /* counter keeps track of when entities are added / removed */
     uint32_t changed;
 
     /* Entity administration */
     corto_entityPerParentSeq entities[CORTO_MAX_SCOPE_DEPTH];
+
+    /* Number of depths that have parents. Entities at larger depths are empty,
+     * and are not copied or visited. */
+    int32_t depthCount;
+
+    /* Set to collect statistics. Counters of writers are stored in stats,
+     * counters of readers are stored per thread. */
+    bool collectStats;
+    corto_entityAdmin_stats_t stats;
+
+    /* Hash index from parent to its location in entities. Snapshots share the
+     * index until it is resized. */
+    corto_entityAdmin_index *index;
+
+    /* Tree of the scopes of parents, used by recursive walks. Shared between
+     * the admin and its snapshots. */
+    corto_entityAdmin_scope *root;
+
+    /* Current snapshot, NULL if no snapshot has been published yet */
+    struct corto_entityAdmin *snapshot;
+
+    /* Incremented when a snapshot is published. For a retired snapshot, the
+     * epoch in which it was replaced. */
+    uint64_t epoch;
+
+    /* Replaced snapshots that may still be read. For a retired snapshot, the
+     * next (older) retired snapshot. */
+    struct corto_entityAdmin *retired;
+
+    /* Snapshots share the buffers of parents that didn't change. A retired
+     * snapshot owns the buffers that were replaced by the next snapshot. */
+    void **garbage;
+    uint32_t garbageCount;
+    size_t garbageBytes;
+
+    /* Threads that read from the admin */
+    corto_entityAdmin_reader *readers;
+
+    /* Parents that changed since the last snapshot. Only used by writers,
+     * readers only check dirtyCount. */
+    corto_entityAdmin_scope **dirty;
+    uint32_t dirtyCount;
+    uint32_t dirtySize;
+
+    /* Location of entity for each handle. Only used by writers. */
+    corto_entityAdmin_slot *slots;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint32_t freeSlot;  /* First free slot + 1, 0 if there is none */
 } corto_entityAdmin;
 
+typedef struct corto_entityAdmin_memory_t {
+    int32_t depthCount;     /* Number of depths that have parents */
+    uint32_t retired;       /* Number of retired snapshots not yet freed */
+    size_t entities;        /* Parents and entity buffers of the admin */
+    size_t scopes;          /* Scope tree and index */
+    size_t handles;         /* Handle slots */
+    size_t readers;         /* Thread readers */
+    size_t snapshot;        /* Current snapshot */
+    size_t retiredBytes;    /* Retired snapshots and buffers they own */
+    size_t total;
+} corto_entityAdmin_memory_t;
+
 int16_t corto_entityAdmin_getDepthFromId(
     const char *id);
 
+/* Get snapshot of the entity administration. The snapshot must not be modified,
+ * and remains valid until the thread calls corto_entityAdmin_get again, or
+ * corto_entityAdmin_release. */
 corto_entityAdmin* corto_entityAdmin_get(
     corto_entityAdmin *_this);
 
+/* Release snapshot obtained by corto_entityAdmin_get. Snapshots that were
+ * replaced after it can't be freed while it is held, so a thread that stops
+ * using the snapshot must release it. Threads that exit release their snapshot
+ * automatically, except for the main thread. */
+void corto_entityAdmin_release(
+    corto_entityAdmin *_this);
+
+/* Add entity to parent. If handle_out is not NULL, it is set to a handle that
+ * can be used to remove the entity with corto_entityAdmin_removeHandle. */
 int16_t corto_entityAdmin_add(
     corto_entityAdmin *_this,
     const char *parent,
     void *e,
-    void *instance);
+    void *instance,
+    corto_entityHandle *handle_out);
 
 int corto_entityAdmin_remove(
     corto_entityAdmin *_this,
@@ -83,6 +190,12 @@ int corto_entityAdmin_remove(
     void *instance,
     bool removeAll);
 
+/* Remove entity that was added with handle. Doesn't search for the entity, so
+ * the cost doesn't depend on the number of entities. */
+int16_t corto_entityAdmin_removeHandle(
+    corto_entityAdmin *_this,
+    corto_entityHandle handle);
+
 int corto_entityAdmin_walk(
     corto_entityAdmin *_this,
     corto_entityWalkAction action,
@@ -90,7 +203,43 @@ int corto_entityAdmin_walk(
     bool recursive,
     void *userData);
 
+/* Walk entities in batches. The action is called with arrays of entities that
+ * belong to the same parent, instead of once for each entity. The walk stops
+ * when the action returns 0. */
+int corto_entityAdmin_walkBatch(
+    corto_entityAdmin *_this,
+    corto_entityBatchAction action,
+    const char *parent,
+    bool recursive,
+    void *userData);
+
+/* Same as corto_entityAdmin_walkBatch, with batches divided over at most the
+ * specified number of threads, including the calling thread. The other threads
+ * are workers of the shared thread pool. The action is called concurrently,
+ * and batches are not visited in a particular order. Small walks are not
+ * divided, as handing off work to another thread costs more than visiting a
+ * few thousand entities. */
+int corto_entityAdmin_walkBatchParallel(
+    corto_entityAdmin *_this,
+    corto_entityBatchAction action,
+    const char *parent,
+    bool recursive,
+    void *userData,
+    uint32_t workers);
+
+/* Get memory used by the admin, its snapshot and retired snapshots */
+void corto_entityAdmin_memory(
+    corto_entityAdmin *_this,
+    corto_entityAdmin_memory_t *memory_out);
+
+/* Get statistics of the admin. Counters only increase while collectStats is
+ * set, and are not reset when it is cleared. */
+void corto_entityAdmin_stats(
+    corto_entityAdmin *_this,
+    corto_entityAdmin_stats_t *stats_out);
+
+/* Release thread reader, used as destructor of the thread key */
 void corto_entityAdmin_free(
-    void *admin);
+    void *reader);
 
 #endif
@@ -31,6 +31,8 @@ typedef struct corto_idmatch_program_s* corto_idmatch_program;
 
 /** Match an id against a pattern.
  * Simple function that tests if an object id matches the provided pattern.
+ * Compiled patterns are kept in a cache with room for CORTO_IDMATCH_CACHE_SIZE
+ * patterns, so repeatedly matching against the same pattern is cheap.
  *
  * @param pattern The pattern against which to match the object identifier
  * @param id The object identifier to match
@@ -60,7 +62,70 @@ corto_idmatch_program corto_idmatch_compile(
     bool allowScopes,
     bool allowSeparators);
 
+/* Allow `/` and `//` in pattern */
+#define CORTO_IDMATCH_ALLOW_SCOPES (0x1)
+
+/* Allow `,` in pattern */
+#define CORTO_IDMATCH_ALLOW_SEPARATORS (0x2)
+
+/* Always use the interpreter, don't compile the program to an automaton */
+#define CORTO_IDMATCH_NO_DFA (0x4)
+
+/** Compile an id expression with flags.
+ * Same as corto_idmatch_compile, with options specified as flags. Unless
+ * CORTO_IDMATCH_NO_DFA is specified, patterns that only contain identifiers,
+ * wildcards, scopes and separators are compiled to an automaton that matches
+ * an id in a single pass over its characters. Patterns with other operators,
+ * or patterns that would result in too large an automaton, are interpreted.
+ *
+ * @param pattern The pattern against which to match the object identifier
+ * @param flags Combination of CORTO_IDMATCH_* flags
+ * @return A compiled version of the string pattern.
+ * @see corto_idmatch_compile corto_idmatch_run corto_idmatch_free
+ */
+CORTO_EXPORT
+corto_idmatch_program corto_idmatch_compileFlags(
+    const char *pattern,
+    uint32_t flags);
+
+/** Save a compiled program to a buffer.
+ * The saved image contains no pointers, and can be written to a file, mapped
+ * into memory and loaded by another process with corto_idmatch_load. Images
+ * use the byte order of the machine they were saved on. If the buffer is NULL
+ * or too small, nothing is written and only the required size is returned.
+ *
+ * @param program A compiled program, created by corto_idmatch_compile
+ * @param buffer The buffer to write the image to.
+ * @param size The size of the buffer.
+ * @return The size of the image.
+ * @see corto_idmatch_load
+ */
+CORTO_EXPORT
+size_t corto_idmatch_save(
+    corto_idmatch_program program,
+    void *buffer,
+    size_t size);
+
+/** Load a compiled program from an image.
+ * Loads an image created by corto_idmatch_save. Loading does not parse the
+ * pattern again, and does not rebuild the automaton of the program, which makes
+ * it considerably cheaper than compiling. The image is copied, so the buffer
+ * may be released or unmapped after the call. Images that are truncated or
+ * inconsistent are rejected.
+ *
+ * @param buffer The buffer that contains the image. Does not have to be aligned.
+ * @param size The size of the buffer.
+ * @return The loaded program, or NULL if the image is invalid.
+ * @see corto_idmatch_save corto_idmatch_free
+ */
+CORTO_EXPORT
+corto_idmatch_program corto_idmatch_load(
+    const void *buffer,
+    size_t size);
+
 /** Run a compiled idmatch program.
+ * A program is not modified after it has been compiled or loaded, so the same
+ * program can be run by multiple threads at the same time without locking.
  *
  * @param program A compiled program, created by corto_idmatch_compile
  * @pattern id The object identifier to match
@@ -72,6 +137,49 @@ bool corto_idmatch_run(
     corto_idmatch_program program,
     const char *id);
 
+/** Run a compiled idmatch program for many identifiers.
+ * The result is the same as calling corto_idmatch_run for each identifier, but
+ * ids that can't match the program are rejected with a fast scan for a literal
+ * that matching ids must contain. The bitset must have room for
+ * (count + 63) / 64 words. After the call, bit (i % 64) of word (i / 64) is
+ * set if identifier i matches.
+ *
+ * @param program A compiled program, created by corto_idmatch_compile
+ * @param ids Array with object identifiers to match.
+ * @param count Number of identifiers.
+ * @param bitset_out Bitset that receives the matching identifiers.
+ * @return Number of matching identifiers.
+ * @see corto_idmatch_run corto_idmatch_runBatchParallel
+ */
+CORTO_EXPORT
+uint32_t corto_idmatch_runBatch(
+    corto_idmatch_program program,
+    const char *ids[],
+    uint32_t count,
+    uint64_t *bitset_out);
+
+/** Run a compiled idmatch program for many identifiers on multiple threads.
+ * Same as corto_idmatch_runBatch, with the identifiers divided over at most
+ * the specified number of workers. The workers are threads of the shared thread
+ * pool (see corto_pool_default). Small batches are not divided, as handing off
+ * work to another thread costs more than matching a few thousand identifiers.
+ *
+ * @param program A compiled program, created by corto_idmatch_compile
+ * @param ids Array with object identifiers to match.
+ * @param count Number of identifiers.
+ * @param bitset_out Bitset that receives the matching identifiers.
+ * @param workers Maximum number of threads, including the calling thread.
+ * @return Number of matching identifiers.
+ * @see corto_idmatch_runBatch
+ */
+CORTO_EXPORT
+uint32_t corto_idmatch_runBatchParallel(
+    corto_idmatch_program program,
+    const char *ids[],
+    uint32_t count,
+    uint64_t *bitset_out,
+    uint32_t workers);
+
 /** Return if program matches single object, n objects or a tree of objects.
  *
  * @param program A compiled program, created by corto_idmatch_compile
@@ -132,6 +240,22 @@ CORTO_EXPORT
 bool corto_idmatch_hasOperators(
     const char *expr);
 
+/** Test whether a program can match identifiers under a parent.
+ * Walkers can use this function to skip subtrees that can't contain a match.
+ * The function returns true if any identifier in the tree under the parent,
+ * excluding the parent itself, could match the program. When this can't be
+ * determined, for example for programs with operators like ^ or |, the
+ * function returns true.
+ *
+ * @param program The program to evaluate
+ * @param prefix The parent identifier. NULL or "/" for the root.
+ * @return false if no identifier under the parent can match the program.
+ */
+CORTO_EXPORT
+bool corto_idmatch_canMatchUnder(
+    corto_idmatch_program program,
+    const char *prefix);
+
 /** Determine whether a pattern matches an object, scope or tree.
  * Learns from a compiled pattern if it matches a tree (`foo//`), a
  * scope (`foo/`) or an object (`foo/bar`).
@@ -144,4 +268,100 @@ CORTO_EXPORT
 int corto_idmatch_get_scope(
     corto_idmatch_program program);
 
+/* -- Program cache -- */
+
+typedef struct corto_idmatch_cache_stats_t {
+    uint64_t hits;      /* Number of calls that found program in cache */
+    uint64_t misses;    /* Number of calls that had to compile program */
+    uint64_t evictions; /* Number of programs removed to make room */
+    uint32_t count;     /* Number of programs in cache */
+    uint32_t capacity;  /* Maximum number of programs in cache */
+} corto_idmatch_cache_stats_t;
+
+/** Add patterns to the cache of corto_idmatch.
+ * Compiles patterns ahead of time, so that the first calls to corto_idmatch
+ * don't have to. When more patterns are provided than fit in the cache, the
+ * last CORTO_IDMATCH_CACHE_SIZE patterns are kept.
+ *
+ * @param exprs Array with patterns.
+ * @param count Number of patterns.
+ * @return 0 if success, -1 if a pattern is invalid.
+ * @see corto_idmatch corto_idmatch_cache_flush
+ */
+CORTO_EXPORT
+int16_t corto_idmatch_cache_prewarm(
+    const char *exprs[],
+    uint32_t count);
+
+/** Remove all patterns from the cache of corto_idmatch.
+ * Counters returned by corto_idmatch_cache_stats are not reset.
+ *
+ * @see corto_idmatch corto_idmatch_cache_prewarm
+ */
+CORTO_EXPORT
+void corto_idmatch_cache_flush(void);
+
+/** Get statistics for the cache of corto_idmatch.
+ *
+ * @param stats_out Structure that will be populated with statistics.
+ */
+CORTO_EXPORT
+void corto_idmatch_cache_stats(
+    corto_idmatch_cache_stats_t *stats_out);
+
+/* -- Pattern sets -- */
+
+typedef struct corto_idmatch_set_s* corto_idmatch_set;
+
+/** Compile a set of id expressions.
+ * A set matches an id against many patterns at once. Patterns are merged into
+ * a single tree of scope elements, so the cost of matching an id grows with
+ * the number of elements in the id, rather than with the number of patterns.
+ * Patterns are compiled as if by corto_idmatch_compile with scopes and
+ * separators allowed, and match the same ids as the individual programs.
+ *
+ * @param patterns Array with patterns.
+ * @param count Number of patterns.
+ * @return The compiled set, or NULL if one of the patterns is invalid.
+ * @see corto_idmatch_set_run corto_idmatch_set_free
+ */
+CORTO_EXPORT
+corto_idmatch_set corto_idmatch_set_compile(
+    const char *patterns[],
+    uint32_t count);
+
+/** Match an id against all patterns in a set.
+ * The bitset must have room for (count + 63) / 64 words, where count is the
+ * number of patterns in the set. After the call, bit (i % 64) of word (i / 64)
+ * is set if pattern i matches the id.
+ *
+ * @param set A set, created by corto_idmatch_set_compile.
+ * @param id The object identifier to match.
+ * @param bitset_out Bitset that receives the matching patterns.
+ * @return Number of matching patterns.
+ * @see corto_idmatch_set_compile corto_idmatch_set_free
+ */
+CORTO_EXPORT
+uint32_t corto_idmatch_set_run(
+    corto_idmatch_set set,
+    const char *id,
+    uint64_t *bitset_out);
+
+/** Return number of patterns in a set.
+ *
+ * @param set A set, created by corto_idmatch_set_compile.
+ * @return The number of patterns.
+ */
+CORTO_EXPORT
+uint32_t corto_idmatch_set_count(
+    corto_idmatch_set set);
+
+/** Free a set.
+ *
+ * @param set A set, created by corto_idmatch_set_compile.
+ */
+CORTO_EXPORT
+void corto_idmatch_set_free(
+    corto_idmatch_set set);
+
 #endif
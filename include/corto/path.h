@@ -49,6 +49,19 @@ char* corto_path_clean(
     char *buf,
     char *path);
 
+/** Create a canonical version of a string slice containing a path.
+ * Same as corto_path_clean, but does not require the path to be null
+ * terminated. The path must not be longer than CORTO_MAX_PATH_LENGTH - 1.
+ *
+ * @param buf Buffer of at least CORTO_MAX_PATH_LENGTH bytes in which to store the result. Must not overlap with path. If NULL, a corto-managed string is returned.
+ * @param path The input path.
+ * @return The path. NULL if the path is too long.
+ */
+CORTO_EXPORT
+char* corto_path_cleanView(
+    char *buf,
+    corto_strview path);
+
 /** Get directory name from path.
  *
  * @param path The input path.
@@ -147,8 +147,8 @@ extern "C" {
 /* Maximum number of arguments for command */
 #define CORTO_MAX_CMD_ARGS (256)
 
-/* Maximum number of operations in an id expression */
-#define CORTO_MATCHER_MAX_OP (32)
+/* Maximum number of compiled id expressions cached by corto_idmatch */
+#define CORTO_IDMATCH_CACHE_SIZE (64)
 
 /* Maximum number of content types in a process */
 #define CORTO_MAX_CONTENTTYPE (32)
@@ -163,6 +163,7 @@ extern "C" {
 #define CORTO_MAX_LOG_CODEFRAMES (16)
 
 /* #define CORTO_WALK_TRACING */
+/* #define CORTO_IDMATCH_VERIFY */
 #define CORTO_IC_TRACING
 #define CORTO_VM_DEBUG
 #define CORTO_VM
@@ -291,6 +292,7 @@ void platform_deinit(void);
 
 /* Base includes */
 #include <corto/os.h>
+#include <corto/strview.h>
 #include <corto/buffer.h>
 #include <corto/iter.h>
 #include <corto/ll.h>
@@ -302,6 +304,7 @@ void platform_deinit(void);
 #include <corto/fs.h>
 #include <corto/posix_thread.h>
 #include <corto/thread.h>
+#include <corto/pool.h>
 #include <corto/file.h>
 #include <corto/env.h>
 #include <corto/util.h>
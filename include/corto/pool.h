@@ -0,0 +1,131 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file
+ * @section pool Thread pool API
+ * @brief Run tasks on a fixed set of worker threads.
+ *
+ * Every worker has its own deque of tasks. Tasks submitted by a worker are
+ * pushed on the deque of that worker, tasks submitted by other threads are put
+ * in a queue that is shared by all workers. A worker without tasks steals them
+ * from the deques of other workers. Threads that wait for a group of tasks
+ * run tasks while they wait.
+ */
+
+#ifndef CORTO_POOL_H
+#define CORTO_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct corto_pool_s* corto_pool;
+typedef void (*corto_pool_cb)(void*);
+
+/* Tasks that are waited for together. Initialize with {0}. */
+typedef struct corto_pool_group {
+    int32_t pending;
+} corto_pool_group;
+
+/** Create new thread pool.
+ *
+ * @param workers Number of worker threads. If 0, one worker per online CPU.
+ * @return Handle to the pool, NULL if failed.
+ */
+CORTO_EXPORT
+corto_pool corto_pool_new(
+    uint32_t workers);
+
+/** Free thread pool.
+ * Tasks that are still queued are run before the workers exit. The function
+ * blocks until all workers have exited. Tasks must not be submitted to the
+ * pool while or after it is freed.
+ *
+ * @param pool Pool to free.
+ */
+CORTO_EXPORT
+void corto_pool_free(
+    corto_pool pool);
+
+/** Return the shared thread pool.
+ * The pool is created when this function is first called, with the number of
+ * workers in the CORTO_POOL_WORKERS environment variable (at most 1024), or one
+ * worker per online CPU if the variable is not set or not a valid number. The
+ * platform_deinit function frees the pool. If the pool cannot be created the
+ * function throws and returns NULL, and creation is retried on the next call.
+ * Callers then run their work on the calling thread.
+ *
+ * @return Handle to the shared pool, NULL if failed.
+ */
+CORTO_EXPORT
+corto_pool corto_pool_default(void);
+
+/** Submit task to thread pool.
+ * Tasks can be submitted from any thread, including from tasks that run in
+ * the pool.
+ *
+ * @param pool Pool that runs the task.
+ * @param group Group to add the task to, NULL if not waited for.
+ * @param action Function to run.
+ * @param arg Argument to pass to function.
+ * @return 0 if success, non-zero if failed.
+ */
+CORTO_EXPORT
+int16_t corto_pool_submit(
+    corto_pool pool,
+    corto_pool_group *group,
+    corto_pool_cb action,
+    void *arg);
+
+/** Wait until all tasks in a group have finished.
+ * The calling thread runs tasks of the pool while it waits, which prevents a
+ * task that waits for other tasks from blocking a worker. When no tasks are
+ * left to run, the thread sleeps until the last task of the group finishes.
+ *
+ * @param pool Pool that runs the tasks of the group.
+ * @param group Group to wait for.
+ */
+CORTO_EXPORT
+void corto_pool_wait(
+    corto_pool pool,
+    corto_pool_group *group);
+
+/** Return number of workers in thread pool.
+ *
+ * @param pool Pool.
+ * @return Number of worker threads.
+ */
+CORTO_EXPORT
+uint32_t corto_pool_workers(
+    corto_pool pool);
+
+/** Return number of online CPUs.
+ *
+ * @return Number of CPUs, at least 1.
+ */
+CORTO_EXPORT
+uint32_t corto_pool_cpuCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -52,13 +52,36 @@ typedef struct corto_mutex_s {
 #endif
 }corto_mutex_s;
     
+/* On Linux semaphores are implemented with a futex, so posting and waiting
+ * only enter the kernel when a thread has to block. Define CORTO_NO_FUTEX to
+ * use a pthread mutex and condition variable instead. */
+#if defined(CORTO_OS_LINUX) && !defined(CORTO_NO_FUTEX)
+#define CORTO_SEM_FUTEX
+#endif
+
 typedef struct corto_sem_s {
+#ifdef CORTO_SEM_FUTEX
+    int value;
+    int waiters;
+#else
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int value;
+#endif
 }corto_sem_s;
 
+/* Define CORTO_MUTEX_ADAPTIVE to let threads spin for a while on a locked mutex
+ * before they block, which is faster for short critical sections on multiple
+ * CPUs. Requires the adaptive mutexes of glibc. */
+#if defined(CORTO_MUTEX_ADAPTIVE) && defined(PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP)
+#define CORTO_MUTEX_SPIN
+#define CORTO_MUTEX_INITIALIZER {PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP}
+#else
+#ifdef CORTO_MUTEX_ADAPTIVE
+#warning "CORTO_MUTEX_ADAPTIVE requires glibc and _GNU_SOURCE, using default mutexes."
+#endif
 #define CORTO_MUTEX_INITIALIZER {PTHREAD_MUTEX_INITIALIZER}
+#endif
 #define CORTO_RWMUTEX_INITIALIZER {PTHREAD_RWLOCK_INITIALIZER}
 
 #ifdef __cplusplus
@@ -55,6 +55,17 @@ int strnicmp(
     int length,
     const char *str2);
 
+/** Test if a string starts with a prefix, insensitive of case.
+ *
+ * @param str String to test.
+ * @param prefix Prefix to look for.
+ * @return 0 if str starts with prefix, otherwise -1 if first unmatched character is smaller, 1 if larger.
+ */
+CORTO_EXPORT
+int strpicmp(
+    const char *str,
+    const char *prefix);
+
 /** Compare strings insensitive of case until specified character is found.
  * This function is useful when comparing tokens in a string that are separated
  * by a single character. This function can also be used to compare regular strings
@@ -118,6 +129,36 @@ size_t stresc(
     size_t n,
     const char *in);
 
+/** Unescape a character.
+ * Reads a character from `in`, which may be an escape sequence as written by
+ * chresc, and writes the unescaped character to `out`. Unknown escape sequences
+ * evaluate to the escaped character.
+ *
+ * @param out Location to write the unescaped character to.
+ * @param in The input string.
+ * @return Next location to read from in the input string.
+ */
+CORTO_EXPORT
+const char *chrunesc(
+    char *out,
+    const char *in);
+
+/* Unescape a null-terminated string.
+ * Reverse of stresc. At most `n` characters are written to `out`, and the
+ * remainder of `out` is filled with null characters. When 0 is provided for n,
+ * nothing is written.
+ *
+ * @param out Output string.
+ * @param n Maximum number of characters to write to output string.
+ * @param in Input string.
+ * @return Length of the unescaped string, excluding the null terminator.
+ */
+CORTO_EXPORT
+size_t strunesc(
+    char *out,
+    size_t n,
+    const char *in);
+
 /** Assign one string to another string without leaking memory.
  *
  * @param out Output string.
@@ -214,6 +255,100 @@ char* strreplace(
     char *replace,
     char *with);
 
+/** Pattern and replacement for strreplacem. */
+typedef struct corto_strreplace_pair {
+    const char *pattern; /* String to replace. Empty patterns are ignored. */
+    const char *with;    /* Replacement. NULL is treated as an empty string. */
+} corto_strreplace_pair;
+
+/** Replace multiple substrings in a single pass.
+ * The input is scanned once from left to right. At each position the longest
+ * matching pattern is replaced; when patterns of equal length match, the one
+ * that comes first in the array is used. Replacements are not rescanned.
+ *
+ * @param str Input string.
+ * @param pairs Array with patterns and their replacements.
+ * @param count Number of elements in pairs.
+ * @return Newly allocated string with all patterns replaced.
+ */
+CORTO_EXPORT
+char* strreplacem(
+    const char *str,
+    const corto_strreplace_pair *pairs,
+    int32_t count);
+
+/** Compute hash for string.
+ *
+ * @param str Input string.
+ * @return Hash value.
+ */
+CORTO_EXPORT
+uint32_t strhash(
+    const char *str);
+
+/** Compute hash for string, insensitive of case.
+ * Strings that are equal according to stricmp have the same hash.
+ *
+ * @param str Input string.
+ * @return Hash value.
+ */
+CORTO_EXPORT
+uint32_t strihash(
+    const char *str);
+
+
+/* -- String interning -- */
+
+typedef struct corto_strintern_stats_t {
+    uint32_t count;     /* Number of unique strings in the pool */
+    uint32_t foldCount; /* Number of case-insensitive keys */
+    size_t bytes;       /* Memory used by strings */
+    size_t tableBytes;  /* Memory used by hash tables */
+} corto_strintern_stats_t;
+
+/** Obtain canonical version of a string.
+ * Returns a pointer to a pooled copy of the string. Interning the same string
+ * twice returns the same pointer, so interned strings can be compared with ==.
+ * The returned string must not be modified or deallocated. Pooled strings stay
+ * valid until platform_deinit is called.
+ *
+ * @param str Input string.
+ * @return Canonical string. NULL if str is NULL.
+ */
+CORTO_EXPORT
+const char* corto_strintern(
+    const char *str);
+
+/** Obtain canonical version of a string, insensitive of case.
+ * Strings that are equal according to stricmp return the same pointer, which
+ * holds the spelling of the first string that was interned with this function.
+ *
+ * @param str Input string.
+ * @return Canonical string. NULL if str is NULL.
+ */
+CORTO_EXPORT
+const char* corto_strinterni(
+    const char *str);
+
+/** Find canonical version of a string without adding it to the pool.
+ * Use this function to look up a string that is compared with interned
+ * strings, so that lookups of strings that aren't in the pool don't grow it.
+ *
+ * @param str Input string.
+ * @return Canonical string. NULL if str is NULL or not in the pool.
+ */
+CORTO_EXPORT
+const char* corto_strintern_find(
+    const char *str);
+
+/** Get memory statistics for the intern pool.
+ *
+ * @param stats_out Structure that will be populated with statistics.
+ */
+CORTO_EXPORT
+void corto_strintern_stats(
+    corto_strintern_stats_t *stats_out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,186 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/** @file
+ * @section strview String view API
+ * @brief Length-carrying string slices that do not need to be null-terminated.
+ */
+
+#ifndef CORTO_STRVIEW_H_
+#define CORTO_STRVIEW_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A string view points to a range of characters in another string. Views do
+ * not own memory and are not null-terminated, which allows splitting and
+ * trimming strings without copying them or scanning them more than once. */
+typedef struct corto_strview {
+    const char *ptr;
+    size_t len;
+} corto_strview;
+
+#define CORTO_STRVIEW(str, len) ((corto_strview){(str), (len)})
+#define CORTO_STRVIEW_LIT(str) ((corto_strview){(str), sizeof(str) - 1})
+#define CORTO_STRVIEW_EMPTY ((corto_strview){"", 0})
+
+/** Create view from null-terminated string.
+ *
+ * @param str Input string. If NULL, an empty view is returned.
+ * @return View that spans the entire string.
+ */
+CORTO_EXPORT
+corto_strview corto_strview_from(
+    const char *str);
+
+/** Get next element from a view, separated by a character.
+ * The function returns the characters up to the first occurrence of sep in
+ * elem_out, and advances str to the first character after sep. Consecutive
+ * separators produce empty elements.
+ *
+ * @param str View to split. Is advanced to the remainder after the element.
+ * @param sep Separator character.
+ * @param elem_out View that will contain the element.
+ * @return true if an element was found, false if str was exhausted.
+ */
+CORTO_EXPORT
+bool corto_strview_next(
+    corto_strview *str,
+    char sep,
+    corto_strview *elem_out);
+
+/** Remove leading and trailing whitespace.
+ *
+ * @param str Input view.
+ * @return View without leading and trailing whitespace.
+ */
+CORTO_EXPORT
+corto_strview corto_strview_trim(
+    corto_strview str);
+
+/** Get subrange of view.
+ * Out of range values for start and len are clamped to the view.
+ *
+ * @param str Input view.
+ * @param start Offset of first character.
+ * @param len Number of characters.
+ * @return View that contains the specified range.
+ */
+CORTO_EXPORT
+corto_strview corto_strview_slice(
+    corto_strview str,
+    size_t start,
+    size_t len);
+
+/** Find first occurrence of a character.
+ *
+ * @param str View to search.
+ * @param ch Character to find.
+ * @return Offset of character, -1 if not found.
+ */
+CORTO_EXPORT
+ptrdiff_t corto_strview_find(
+    corto_strview str,
+    char ch);
+
+/** Find first occurrence of a substring.
+ *
+ * @param str View to search.
+ * @param needle Substring to find.
+ * @return Offset of substring, -1 if not found.
+ */
+CORTO_EXPORT
+ptrdiff_t corto_strview_findstr(
+    corto_strview str,
+    corto_strview needle);
+
+/** Test if two views are equal.
+ *
+ * @param str1 First view.
+ * @param str2 Second view.
+ * @return true if equal, false if not equal.
+ */
+CORTO_EXPORT
+bool corto_strview_equals(
+    corto_strview str1,
+    corto_strview str2);
+
+/** Test if two views are equal, insensitive of case.
+ *
+ * @param str1 First view.
+ * @param str2 Second view.
+ * @return true if equal, false if not equal.
+ */
+CORTO_EXPORT
+bool corto_strview_iequals(
+    corto_strview str1,
+    corto_strview str2);
+
+/** Test if view starts with prefix, insensitive of case.
+ *
+ * @param str View to test.
+ * @param prefix Prefix to look for.
+ * @return true if str starts with prefix, false if it does not.
+ */
+CORTO_EXPORT
+bool corto_strview_iprefix(
+    corto_strview str,
+    corto_strview prefix);
+
+/** Compute hash for view, insensitive of case.
+ * Returns the same value as strihash for a null-terminated copy of the view.
+ *
+ * @param str Input view.
+ * @return Hash value.
+ */
+CORTO_EXPORT
+uint32_t corto_strview_ihash(
+    corto_strview str);
+
+/** Create null-terminated copy of view.
+ *
+ * @param str Input view.
+ * @return Newly allocated string.
+ */
+CORTO_EXPORT
+char* corto_strview_dup(
+    corto_strview str);
+
+/** Replace substring with other string.
+ * Equivalent to strreplace, but does not rescan input strings for length.
+ *
+ * @param str Input view.
+ * @param replace To be replaced string. If empty, a copy of str is returned.
+ * @param with String to replace with.
+ * @return Newly allocated string with all instances of 'replace' replaced.
+ */
+CORTO_EXPORT
+char* corto_strview_replace(
+    corto_strview str,
+    corto_strview replace,
+    corto_strview with);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
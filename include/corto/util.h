@@ -57,6 +57,9 @@ extern "C" {
 /* Set intern TLS string */
 CORTO_EXPORT char* corto_setThreadString(char* string);
 
+/* Set intern TLS string from a string slice */
+CORTO_EXPORT char* corto_setThreadStringView(corto_strview string);
+
 #ifdef __cplusplus
 }
 #endif
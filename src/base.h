@@ -5,5 +5,8 @@
 #include <corto/platform.h>
 
 int16_t corto_log_init(void);
+void corto_strintern_deinit(void);
+void corto_idmatch_cache_deinit(void);
+void corto_pool_deinit(void);
 
 #endif
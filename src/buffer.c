@@ -20,6 +20,7 @@
  */
 
 #include <corto/platform.h>
+#include "simd.h"
 
 /* Add an extra element to the buffer */
 static void corto_buffer_grow(corto_buffer *b) {
@@ -291,6 +292,94 @@ bool corto_buffer_appendstrn(
     );
 }
 
+static uint32_t corto_buffer_viewcpy(
+    char *dst,
+    char *src,
+    int32_t len,
+    void *userData)
+{
+    uint32_t srclen = ((corto_strview*)userData)->len;
+
+    /* Length is known, so characters can be copied in one go */
+    memcpy(dst, src, (len < 0) ? 0 : ((uint32_t)len < srclen) ? (uint32_t)len : srclen);
+
+    return srclen;
+}
+
+bool corto_buffer_appendview(
+    corto_buffer *b,
+    corto_strview str)
+{
+    return corto_buffer_appendIntern(
+        b, (char*)str.ptr, &str, corto_buffer_viewcpy
+    );
+}
+
+bool corto_buffer_appendesc(
+    corto_buffer *b,
+    const char *str,
+    char delimiter)
+{
+    const char *ptr = str;
+    char esc[3];
+
+    if (!ptr) {
+        return true;
+    }
+
+    while (true) {
+        size_t run = corto_simd_strescspan(ptr, delimiter);
+        if (run && !corto_buffer_appendview(b, CORTO_STRVIEW(ptr, run))) {
+            return false;
+        }
+        ptr += run;
+
+        if (!*ptr) {
+            break;
+        }
+
+        chresc(esc, *ptr, delimiter);
+        if (!corto_buffer_appendview(b, CORTO_STRVIEW(esc, 2))) {
+            return false;
+        }
+        ptr ++;
+    }
+
+    return true;
+}
+
+bool corto_buffer_appendunesc(
+    corto_buffer *b,
+    const char *str)
+{
+    const char *ptr = str, *esc;
+    char ch;
+
+    if (!ptr) {
+        return true;
+    }
+
+    while (true) {
+        esc = strchr(ptr, '\\');
+        size_t run = esc ? (size_t)(esc - ptr) : strlen(ptr);
+        if (run && !corto_buffer_appendview(b, CORTO_STRVIEW(ptr, run))) {
+            return false;
+        }
+        ptr += run;
+
+        if (!*ptr) {
+            break;
+        }
+
+        ptr = chrunesc(&ch, ptr);
+        if (!corto_buffer_appendview(b, CORTO_STRVIEW(&ch, 1))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 char* corto_buffer_str(corto_buffer *b) {
     char* result = NULL;
 
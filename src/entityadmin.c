@@ -19,105 +19,653 @@
  * THE SOFTWARE.
  */
 
-/* Free all entityscriptoins, but do not free corto_entityAdmin itself so
- * it can be reused when a thread needs to copy global entities */
-
 #include <corto/platform.h>
 
+/* Readers announce the oldest epoch in which they obtained a snapshot that they
+ * may still be reading. Snapshots that were retired in an epoch up to the
+ * oldest announced epoch can no longer be read, and are freed by the next
+ * writer. A reader that isn't reading a snapshot announces
+ * CORTO_ENTITYADMIN_IDLE. */
+#define CORTO_ENTITYADMIN_IDLE (UINT64_MAX)
+
+struct corto_entityAdmin_reader {
+    corto_entityAdmin_reader *next;
+    uint64_t epoch;      /* Announced epoch */
+    uint64_t getEpoch;   /* Epoch of snapshot returned by get */
+    uint64_t walkEpoch;  /* Epoch of snapshot of outermost walk */
+    int32_t walking;     /* Number of nested walks */
+    int32_t active;      /* Set while reader is owned by a thread */
+    uint64_t gets;       /* Statistics, only modified by owning thread */
+    uint64_t walks;
+    uint64_t visited;
+};
+
+/* Parents are organized in a tree of scopes, so that a recursive walk only
+ * visits the parents in the scope it walks. Scopes are created for parents and
+ * for the scopes that contain them. Parents are never removed from the admin,
+ * and their location in entities doesn't change, so scopes are only added. The
+ * writer adds scopes while readers may be walking the tree. A scope is
+ * published by storing it in its container last. */
+struct corto_entityAdmin_scope {
+    const char *parent;     /* Interned with corto_strinterni */
+    int16_t depth;
+    int32_t index;          /* Index in entities at depth, -1 if the scope
+                             * isn't a parent */
+    corto_entityAdmin_scope *scopes; /* First scope in scope */
+    corto_entityAdmin_scope *last;   /* Last scope in scope, used by writer */
+    corto_entityAdmin_scope *next;   /* Next scope in container */
+    uint32_t *slots;        /* Slot of each entity of parent, used by writer */
+    uint32_t size;          /* Size of entities buffer of parent and slots */
+    bool dirty;             /* Changed since the last snapshot, used by writer */
+};
+
+/* Entities of a parent are stored in a buffer that grows geometrically */
+#define CORTO_ENTITYADMIN_MIN_ENTITIES (4)
+
+/* Location of the entity of a handle. A handle stores the slot and its
+ * generation. The generation is incremented when the entity is removed, so
+ * that a handle to the entity is invalid when the slot is reused. */
+struct corto_entityAdmin_slot {
+    corto_entityAdmin_scope *scope; /* NULL if slot is free */
+    uint32_t index;         /* Index in entities of parent. If slot is free,
+                             * next free slot + 1. */
+    uint32_t generation;    /* Never 0 */
+};
+
+#define CORTO_ENTITYADMIN_MIN_SLOTS (64)
+
+/* Number of entities that a parallel walk passes to the action at once */
+#define CORTO_ENTITYADMIN_BATCH_SIZE (1024)
+
+/* Parallel walks are not divided over more workers than the number of walked
+ * entities allows, as starting a thread costs more than visiting them */
+#define CORTO_ENTITYADMIN_BATCH_MIN_WORKER_ENTITIES (8192)
+
+/* Scopes are indexed by a hash table with open addressing. Like scopes,
+ * entries are only added. An entry is published by storing its scope last. */
+typedef struct corto_entityAdmin_indexEntry {
+    corto_entityAdmin_scope *scope; /* NULL if entry is empty */
+    uint32_t hash;
+} corto_entityAdmin_indexEntry;
+
+struct corto_entityAdmin_index {
+    uint32_t size;          /* Always a power of two */
+    uint32_t count;
+    corto_entityAdmin_indexEntry entries[];
+};
+
+#define CORTO_ENTITYADMIN_INDEX_MIN_SIZE (16)
+
+/* Snapshot that is returned while no entities have been added */
+static corto_entityAdmin corto_entityAdmin_empty;
+
+/* Release reader when thread shuts down. The reader is kept in the list of
+ * readers of the admin, so it can be reused by another thread. */
+void corto_entityAdmin_free(
+    void *reader)
+{
+    corto_entityAdmin_reader *data = reader;
+    if (data) {
+        data->getEpoch = CORTO_ENTITYADMIN_IDLE;
+        data->walking = 0;
+        __atomic_store_n(&data->epoch, CORTO_ENTITYADMIN_IDLE, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&data->active, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* Acquire write lock, and measure how long the thread waited for it if
+ * statistics are collected. The clock is only read if the lock is busy. */
+static
+int corto_entityAdmin_lock(
+    corto_entityAdmin *this)
+{
+    if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+        if (corto_rwmutex_tryWrite(&this->lock)) {
+            struct timespec start, stop;
+            corto_catch();
+            timespec_gettime(&start);
+            if (corto_rwmutex_write(&this->lock)) {
+                goto error;
+            }
+            timespec_gettime(&stop);
+            stop = timespec_sub(stop, start);
+            this->stats.lockWait += stop.tv_sec * 1000000000ull + stop.tv_nsec;
+        }
+        this->stats.locks ++;
+    } else if (corto_rwmutex_write(&this->lock)) {
+        goto error;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+/* Add to counter of reader. Counters are only modified by the thread that
+ * owns the reader, and may be read by other threads. */
 static
-void corto_entityAdmin_freeEntities(
-    corto_entityAdmin *data)
+void corto_entityAdmin_count(
+    corto_entityAdmin *this,
+    uint64_t *counter,
+    uint64_t count)
 {
-    int32_t depth, sp;
+    if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+        __atomic_store_n(counter,
+            __atomic_load_n(counter, __ATOMIC_RELAXED) + count,
+            __ATOMIC_RELAXED);
+    }
+}
 
-    for (depth = 0; depth < CORTO_MAX_SCOPE_DEPTH; depth ++) {
-        for (sp = 0; sp < data->entities[depth].length; sp++) {
-            corto_entityPerParent *entityPerParent = &data->entities[depth].buffer[sp];
-            corto_dealloc(entityPerParent->entities.buffer);
+/* Free retired snapshots that can no longer be read. Must be called while
+ * holding the write lock. */
+static
+void corto_entityAdmin_reclaim(
+    corto_entityAdmin *this)
+{
+    corto_entityAdmin_reader *reader;
+    corto_entityAdmin *snapshot, **ptr = &this->retired;
+    uint64_t oldest = CORTO_ENTITYADMIN_IDLE;
+
+    for (reader = this->readers; reader; reader = reader->next) {
+        uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if (epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    /* Retired snapshots are ordered from new to old */
+    while ((snapshot = *ptr) && (snapshot->epoch > oldest)) {
+        ptr = &snapshot->retired;
+    }
+    *ptr = NULL;
+
+    while (snapshot) {
+        corto_entityAdmin *next = snapshot->retired;
+        uint32_t i;
+        for (i = 0; i < snapshot->garbageCount; i ++) {
+            corto_dealloc(snapshot->garbage[i]);
+        }
+        corto_dealloc(snapshot->garbage);
+        corto_dealloc(snapshot);
+        snapshot = next;
+        if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+            this->stats.reclaimed ++;
         }
-        corto_dealloc(data->entities[depth].buffer);
-        data->entities[depth].buffer = NULL;
-        data->entities[depth].length = 0;
     }
 }
 
-/* Free all data when thread shuts down */
-void corto_entityAdmin_free(
-    void *admin)
+/* Publish snapshot of global admin, and retire the previous snapshot. The new
+ * snapshot copies the array of parents at the depths of the dirty parents and
+ * the entities of the dirty parents, and shares all other buffers with the
+ * previous snapshot. Must be called while holding the write lock. */
+static
+void corto_entityAdmin_publish(
+    corto_entityAdmin *this)
 {
-    corto_entityAdmin *data = admin;
-    if (data) {
-        corto_entityAdmin_freeEntities(data);
-        corto_dealloc(data);
+    corto_entityAdmin *snapshot = corto_calloc(sizeof(corto_entityAdmin));
+    corto_entityAdmin *prev = this->snapshot;
+    uint32_t dirtyCount = this->dirtyCount, i;
+    uint64_t depths = 0, epoch;
+    void **garbage;
+    uint32_t garbageCount = 0;
+    size_t garbageBytes = 0, bytesCopied = 0;
+    int32_t d;
+
+    if (!prev) {
+        prev = &corto_entityAdmin_empty;
+    }
+
+    /* Depths are only added, so the previous snapshot has no more depths.
+     * Depths that are not used are left empty. */
+    snapshot->depthCount = this->depthCount;
+    memcpy(snapshot->entities, prev->entities,
+        prev->depthCount * sizeof(corto_entityPerParentSeq));
+
+    for (i = 0; i < dirtyCount; i ++) {
+        depths |= 1ull << this->dirty[i]->depth;
     }
+    /* Each dirty parent replaces at most its entities and the parents at its
+     * depth, and the index may be replaced */
+    garbage = corto_alloc((dirtyCount * 2 + 1) * sizeof(void*));
+
+    /* Index is replaced when it is resized */
+    snapshot->index = this->index;
+    snapshot->root = this->root;
+    if (prev->index && (prev->index != this->index)) {
+        garbage[garbageCount ++] = prev->index;
+        garbageBytes += sizeof(corto_entityAdmin_index) +
+            prev->index->size * sizeof(corto_entityAdmin_indexEntry);
+    }
+
+    for (d = 0; d < this->depthCount; d ++) {
+        corto_entityPerParentSeq *src = &this->entities[d];
+        corto_entityPerParentSeq *dst = &snapshot->entities[d];
+        corto_entityPerParentSeq *old = &prev->entities[d];
+
+        if (!(depths & (1ull << d))) {
+            continue;
+        }
+
+        dst->length = src->length;
+        dst->buffer = corto_alloc(src->length * sizeof(corto_entityPerParent));
+        if (old->length) {
+            memcpy(dst->buffer, old->buffer,
+                old->length * sizeof(corto_entityPerParent));
+        }
+        for (i = old->length; i < src->length; i ++) {
+            dst->buffer[i].parent = src->buffer[i].parent;
+            dst->buffer[i].entities.length = 0;
+            dst->buffer[i].entities.buffer = NULL;
+        }
+        if (old->buffer) {
+            garbage[garbageCount ++] = old->buffer;
+            garbageBytes += old->length * sizeof(corto_entityPerParent);
+        }
+        bytesCopied += dst->length * sizeof(corto_entityPerParent);
+    }
+
+    for (i = 0; i < dirtyCount; i ++) {
+        corto_entityAdmin_scope *scope = this->dirty[i];
+        corto_entitySeq *srcSeq =
+            &this->entities[scope->depth].buffer[scope->index].entities;
+        corto_entitySeq *dstSeq =
+            &snapshot->entities[scope->depth].buffer[scope->index].entities;
+
+        if (dstSeq->buffer) {
+            garbage[garbageCount ++] = dstSeq->buffer;
+            garbageBytes += dstSeq->length * sizeof(corto_entity);
+        }
+
+        dstSeq->length = srcSeq->length;
+        if (srcSeq->length) {
+            dstSeq->buffer = corto_alloc(srcSeq->length * sizeof(corto_entity));
+            memcpy(dstSeq->buffer, srcSeq->buffer,
+                srcSeq->length * sizeof(corto_entity));
+        } else {
+            dstSeq->buffer = NULL;
+        }
+        bytesCopied += dstSeq->length * sizeof(corto_entity);
+
+        scope->dirty = false;
+    }
+
+    snapshot->count = this->count;
+    snapshot->changed = this->changed;
+
+    if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+        this->stats.snapshots ++;
+        this->stats.bytesCopied +=
+            prev->depthCount * sizeof(corto_entityPerParentSeq) + bytesCopied;
+    }
+
+    /* Readers that obtain the new epoch are guaranteed to see the new
+     * snapshot, since the snapshot is stored first */
+    __atomic_store_n(&this->snapshot, snapshot, __ATOMIC_SEQ_CST);
+    epoch = __atomic_add_fetch(&this->epoch, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&this->dirtyCount, 0, __ATOMIC_RELAXED);
+
+    if (prev != &corto_entityAdmin_empty) {
+        prev->epoch = epoch;
+        prev->garbage = garbage;
+        prev->garbageCount = garbageCount;
+        prev->garbageBytes = garbageBytes;
+        prev->retired = this->retired;
+        this->retired = prev;
+    } else {
+        corto_dealloc(garbage);
+    }
+
+    corto_entityAdmin_reclaim(this);
 }
 
-/* Copy data from global admin to (local) thread admin */
+/* Mark parent as changed. The snapshot is published when a thread reads the
+ * admin, so that a series of changes without reads only publishes once. Must
+ * be called while holding the write lock. */
 static
-int16_t corto_entityAdmin_copyIn(
-    corto_entityAdmin *src,
-    corto_entityAdmin *dst)
+void corto_entityAdmin_markDirty(
+    corto_entityAdmin *this,
+    corto_entityAdmin_scope *scope)
 {
-    int32_t depth, sp;
+    if (!scope->dirty) {
+        if (this->dirtyCount == this->dirtySize) {
+            this->dirtySize = this->dirtySize ? this->dirtySize * 2 : 16;
+            this->dirty = corto_realloc(this->dirty,
+                this->dirtySize * sizeof(corto_entityAdmin_scope*));
+        }
+        this->dirty[this->dirtyCount] = scope;
+        scope->dirty = true;
+
+        /* Readers only check if the admin is dirty, and publish the snapshot
+         * while holding the write lock */
+        __atomic_store_n(&this->dirtyCount, this->dirtyCount + 1,
+            __ATOMIC_RELAXED);
+    }
+}
 
-    if (src->count) {
-        if (corto_rwmutex_read(&src->lock)) {
+/* Publish snapshot if the admin changed since the last snapshot */
+static
+int corto_entityAdmin_update(
+    corto_entityAdmin *this)
+{
+    if (__atomic_load_n(&this->dirtyCount, __ATOMIC_RELAXED)) {
+        if (corto_entityAdmin_lock(this)) {
             goto error;
         }
+        if (this->dirtyCount) {
+            corto_entityAdmin_publish(this);
+        }
+        if (corto_rwmutex_unlock(&this->lock)) {
+            goto error;
+        }
+    }
 
-        for (depth = 0; depth < CORTO_MAX_SCOPE_DEPTH; depth ++) {
-            dst->entities[depth].length = src->entities[depth].length;
-            dst->entities[depth].buffer =
-                corto_alloc(dst->entities[depth].length * sizeof(corto_entityPerParent));
+    return 0;
+error:
+    return -1;
+}
 
-            for (sp = 0; sp < src->entities[depth].length; sp++) {
-                corto_entityPerParent *srcSubParent = &src->entities[depth].buffer[sp];
-                corto_entityPerParent *dstSubParent = &dst->entities[depth].buffer[sp];
+static
+void corto_entityAdmin_indexInsert(
+    corto_entityAdmin_index *index,
+    corto_entityAdmin_scope *scope,
+    uint32_t hash)
+{
+    uint32_t mask = index->size - 1, i = hash & mask;
 
-                dstSubParent->parent = srcSubParent->parent;
-                dstSubParent->entities.length = srcSubParent->entities.length;
-                dstSubParent->entities.buffer =
-                    corto_alloc(dstSubParent->entities.length * sizeof(corto_entity));
+    while (index->entries[i].scope) {
+        i = (i + 1) & mask;
+    }
 
-                memcpy (
-                    dstSubParent->entities.buffer,
-                    srcSubParent->entities.buffer,
-                    srcSubParent->entities.length * sizeof(corto_entity));
+    index->entries[i].hash = hash;
+    __atomic_store_n(&index->entries[i].scope, scope, __ATOMIC_RELEASE);
+    index->count ++;
+}
+
+/* Add scope to index. If the index is too small, it is replaced by a larger
+ * index, and the old index is freed with the snapshot that still uses it. Must
+ * be called while holding the write lock. */
+static
+void corto_entityAdmin_indexAdd(
+    corto_entityAdmin *this,
+    corto_entityAdmin_scope *scope,
+    uint32_t hash)
+{
+    corto_entityAdmin_index *index = this->index;
+
+    if (!index || ((index->count + 1) * 2 > index->size)) {
+        uint32_t size = index ? index->size * 2 : CORTO_ENTITYADMIN_INDEX_MIN_SIZE;
+        corto_entityAdmin_index *resized = corto_calloc(
+            sizeof(corto_entityAdmin_index) +
+            size * sizeof(corto_entityAdmin_indexEntry));
+        resized->size = size;
+
+        if (index) {
+            uint32_t i;
+            for (i = 0; i < index->size; i ++) {
+                corto_entityAdmin_indexEntry *entry = &index->entries[i];
+                if (entry->scope) {
+                    corto_entityAdmin_indexInsert(
+                        resized, entry->scope, entry->hash);
+                }
+            }
+
+            /* Free index now if no snapshot uses it */
+            if (!this->snapshot || (this->snapshot->index != index)) {
+                corto_dealloc(index);
             }
         }
 
-        if (corto_rwmutex_unlock(&src->lock)) {
+        this->index = index = resized;
+    }
+
+    corto_entityAdmin_indexInsert(index, scope, hash);
+}
+
+/* Find scope of parent. Parent is compared insensitive of case. Scopes that
+ * were added after a snapshot was published are also found in the snapshot. */
+static
+corto_entityAdmin_scope* corto_entityAdmin_indexFind(
+    corto_entityAdmin *admin,
+    const char *parent,
+    uint32_t hash)
+{
+    corto_entityAdmin_index *index = admin->index;
+    if (index) {
+        uint32_t mask = index->size - 1, i;
+        corto_entityAdmin_scope *scope;
+
+        for (i = hash & mask;
+            (scope = __atomic_load_n(
+                &index->entries[i].scope, __ATOMIC_ACQUIRE));
+            i = (i + 1) & mask)
+        {
+            if ((index->entries[i].hash == hash) &&
+                ((scope->parent == parent) || !stricmp(scope->parent, parent)))
+            {
+                return scope;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Get location of scope in entities of admin, which may be a snapshot.
+ * Returns -1 if the scope isn't a parent in the admin. */
+static
+int32_t corto_entityAdmin_scopeIndex(
+    corto_entityAdmin *admin,
+    corto_entityAdmin_scope *scope)
+{
+    int32_t sp = __atomic_load_n(&scope->index, __ATOMIC_RELAXED);
+    if ((sp != -1) && ((uint32_t)sp >= admin->entities[scope->depth].length)) {
+        sp = -1;
+    }
+    return sp;
+}
+
+/* Find or create scope of parent, and the scopes that contain it. Parent must
+ * be interned. Must be called while holding the write lock. */
+static
+corto_entityAdmin_scope* corto_entityAdmin_scopeAdd(
+    corto_entityAdmin *this,
+    const char *parent)
+{
+    uint32_t hash = strihash(parent);
+    corto_entityAdmin_scope *result, *container = NULL;
+
+    result = corto_entityAdmin_indexFind(this, parent, hash);
+    if (result) {
+        return result;
+    }
+
+    /* The root scope ("/") contains "/a", which contains "/a/b" */
+    if (parent[1]) {
+        const char *sep = strrchr(parent, '/');
+        const char *id = "/";
+        char *tmp = NULL;
+        if (sep != parent) {
+            tmp = corto_alloc(sep - parent + 1);
+            memcpy(tmp, parent, sep - parent);
+            tmp[sep - parent] = '\0';
+            id = tmp;
+        }
+
+        id = corto_strinterni(id);
+        corto_dealloc(tmp);
+        if (!id) {
+            goto error;
+        }
+
+        container = corto_entityAdmin_scopeAdd(this, id);
+        if (!container) {
             goto error;
         }
     }
 
-    return 0;
+    result = corto_calloc(sizeof(corto_entityAdmin_scope));
+    result->parent = parent;
+    result->depth = corto_entityAdmin_getDepthFromId(parent);
+    result->index = -1;
+
+    /* Snapshots get the root when they are published */
+    if (!container) {
+        this->root = result;
+    } else if (container->last) {
+        __atomic_store_n(&container->last->next, result, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&container->scopes, result, __ATOMIC_RELEASE);
+    }
+    if (container) {
+        container->last = result;
+    }
+
+    corto_entityAdmin_indexAdd(this, result, hash);
+
+    return result;
 error:
-    return -1;
+    return NULL;
 }
 
-corto_entityAdmin* corto_entityAdmin_get(
+/* Allocate slot for entity at index in entities of parent. Must be called
+ * while holding the write lock. */
+static
+uint32_t corto_entityAdmin_slotNew(
+    corto_entityAdmin *this,
+    corto_entityAdmin_scope *scope,
+    uint32_t index)
+{
+    uint32_t slot;
+
+    if (this->freeSlot) {
+        slot = this->freeSlot - 1;
+        this->freeSlot = this->slots[slot].index;
+    } else {
+        if (this->slotCount == this->slotSize) {
+            this->slotSize = this->slotSize
+                ? this->slotSize * 2
+                : CORTO_ENTITYADMIN_MIN_SLOTS;
+            this->slots = corto_realloc(
+                this->slots, this->slotSize * sizeof(corto_entityAdmin_slot));
+        }
+        slot = this->slotCount ++;
+        this->slots[slot].generation = 1;
+    }
+
+    this->slots[slot].scope = scope;
+    this->slots[slot].index = index;
+
+    return slot;
+}
+
+/* Free slot of removed entity. Must be called while holding the write lock. */
+static
+void corto_entityAdmin_slotFree(
+    corto_entityAdmin *this,
+    uint32_t slot)
+{
+    corto_entityAdmin_slot *data = &this->slots[slot];
+    if (!++ data->generation) {
+        data->generation = 1;
+    }
+    data->scope = NULL;
+    data->index = this->freeSlot;
+    this->freeSlot = slot + 1;
+}
+
+/* Get reader for the current thread */
+static
+corto_entityAdmin_reader* corto_entityAdmin_getReader(
     corto_entityAdmin *this)
 {
-    corto_entityAdmin *result = corto_tls_get(this->key);
+    corto_entityAdmin_reader *result = corto_tls_get(this->key);
     if (!result) {
-        result = corto_calloc(sizeof(corto_entityAdmin));
-        corto_tls_set(this->key, result);
-    }
+        if (corto_entityAdmin_lock(this)) {
+            goto error;
+        }
+
+        /* Reuse reader of a thread that has shut down */
+        for (result = this->readers; result; result = result->next) {
+            if (!__atomic_load_n(&result->active, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+        }
+        if (!result) {
+            result = corto_calloc(sizeof(corto_entityAdmin_reader));
+            result->epoch = CORTO_ENTITYADMIN_IDLE;
+            result->getEpoch = CORTO_ENTITYADMIN_IDLE;
+            result->next = this->readers;
+            this->readers = result;
+        }
+        __atomic_store_n(&result->active, 1, __ATOMIC_RELAXED);
 
-    if (result->changed != this->changed) {
-        corto_entityAdmin_freeEntities(result);
-        if (corto_entityAdmin_copyIn(this, result)) {
+        if (corto_rwmutex_unlock(&this->lock)) {
             goto error;
         }
-        result->changed = this->changed;
+
+        corto_tls_set(this->key, result);
+    }
+
+    return result;
+error:
+    return NULL;
+}
+
+/* Announce oldest epoch of the snapshots that the thread is reading */
+static
+void corto_entityAdmin_announce(
+    corto_entityAdmin_reader *reader)
+{
+    uint64_t epoch = reader->getEpoch;
+    if (reader->walking && (reader->walkEpoch < epoch)) {
+        epoch = reader->walkEpoch;
     }
+    __atomic_store_n(&reader->epoch, epoch, __ATOMIC_SEQ_CST);
+}
 
+/* Load current snapshot. The epoch must be announced before the snapshot is
+ * loaded. A snapshot loaded after the announcement is at least as new as the
+ * announced epoch, so it is retired in a later epoch. */
+static
+corto_entityAdmin* corto_entityAdmin_load(
+    corto_entityAdmin *this)
+{
+    corto_entityAdmin *result = __atomic_load_n(&this->snapshot, __ATOMIC_SEQ_CST);
+    if (!result) {
+        result = &corto_entityAdmin_empty;
+    }
     return result;
+}
+
+corto_entityAdmin* corto_entityAdmin_get(
+    corto_entityAdmin *this)
+{
+    corto_entityAdmin_reader *reader = corto_entityAdmin_getReader(this);
+    if (!reader || corto_entityAdmin_update(this)) {
+        goto error;
+    }
+
+    /* Replaces the snapshot previously returned by get. Snapshots of walks
+     * in progress remain announced. */
+    reader->getEpoch = __atomic_load_n(&this->epoch, __ATOMIC_SEQ_CST);
+    corto_entityAdmin_announce(reader);
+    corto_entityAdmin_count(this, &reader->gets, 1);
+
+    return corto_entityAdmin_load(this);
 error:
     return NULL;
 }
 
+void corto_entityAdmin_release(
+    corto_entityAdmin *this)
+{
+    corto_entityAdmin_reader *reader = corto_tls_get(this->key);
+    if (reader && (reader->getEpoch != CORTO_ENTITYADMIN_IDLE)) {
+        reader->getEpoch = CORTO_ENTITYADMIN_IDLE;
+        corto_entityAdmin_announce(reader);
+    }
+}
+
 int16_t corto_entityAdmin_getDepthFromId(
     const char *id)
 {
@@ -131,6 +679,191 @@ int16_t corto_entityAdmin_getDepthFromId(
     return result;
 }
 
+/* Called for the entities of each parent that is visited by a walk. Returns 0
+ * to stop the walk. */
+typedef int (*corto_entityAdmin_visitAction)(
+    corto_entitySeq *seq,
+    void *ctx);
+
+/* Visit entities of scope, and of all scopes in the scope. Parents are visited
+ * before the parents in their scope. */
+static
+int corto_entityAdmin_visitScope(
+    corto_entityAdmin *admin,
+    corto_entityAdmin_scope *scope,
+    corto_entityAdmin_visitAction visit,
+    void *ctx)
+{
+    int32_t sp = corto_entityAdmin_scopeIndex(admin, scope);
+    corto_entityAdmin_scope *child;
+
+    if (sp != -1) {
+        if (!visit(&admin->entities[scope->depth].buffer[sp].entities, ctx)) {
+            return 0;
+        }
+    }
+
+    for (child = __atomic_load_n(&scope->scopes, __ATOMIC_ACQUIRE);
+        child;
+        child = __atomic_load_n(&child->next, __ATOMIC_ACQUIRE))
+    {
+        if (!corto_entityAdmin_visitScope(admin, child, visit, ctx)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Visit all entities. Visiting the parents by depth is faster than walking the
+ * tree of scopes, since the parents of a depth are stored in a single array. */
+static
+int corto_entityAdmin_visitAll(
+    corto_entityAdmin *admin,
+    corto_entityAdmin_visitAction visit,
+    void *ctx)
+{
+    int32_t d;
+    uint32_t sp;
+
+    for (d = 0; d < admin->depthCount; d ++) {
+        for (sp = 0; sp < admin->entities[d].length; sp ++) {
+            if (!visit(&admin->entities[d].buffer[sp].entities, ctx)) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* Visit entities of parents that are walked in snapshot */
+static
+int corto_entityAdmin_visit(
+    corto_entityAdmin *admin,
+    const char *parent,
+    bool recursive,
+    corto_entityAdmin_visitAction visit,
+    void *ctx)
+{
+    int result = 1;
+
+    /* Entities added without parent are added to the root */
+    if (parent && !parent[0]) {
+        parent = "/";
+    }
+
+    if (admin->count) {
+        corto_entityAdmin_scope *scope = NULL;
+        if (parent) {
+            scope = corto_entityAdmin_indexFind(admin, parent, strihash(parent));
+        }
+
+        if (!parent || (recursive && scope && (scope == admin->root))) {
+            result = corto_entityAdmin_visitAll(admin, visit, ctx);
+        } else if (scope) {
+            if (!recursive) {
+                int32_t sp = corto_entityAdmin_scopeIndex(admin, scope);
+                if (sp != -1) {
+                    result = visit(
+                        &admin->entities[scope->depth].buffer[sp].entities, ctx);
+                }
+            } else {
+                result = corto_entityAdmin_visitScope(admin, scope, visit, ctx);
+            }
+        }
+    }
+
+    return result;
+}
+
+/* Get snapshot for walk. The snapshot remains valid until walkEnd. */
+static
+corto_entityAdmin* corto_entityAdmin_walkBegin(
+    corto_entityAdmin *this,
+    corto_entityAdmin_reader **reader_out)
+{
+    corto_entityAdmin_reader *reader = corto_entityAdmin_getReader(this);
+    if (!reader || corto_entityAdmin_update(this)) {
+        corto_throw("failed to obtain entity admin");
+        goto error;
+    }
+
+    /* The outermost walk announces its epoch until it is done, so that walks
+     * started by the action can't cause the snapshot to be freed */
+    if (!reader->walking) {
+        reader->walkEpoch = __atomic_load_n(&this->epoch, __ATOMIC_SEQ_CST);
+        reader->walking ++;
+        corto_entityAdmin_announce(reader);
+    } else {
+        reader->walking ++;
+    }
+
+    *reader_out = reader;
+    return corto_entityAdmin_load(this);
+error:
+    return NULL;
+}
+
+static
+void corto_entityAdmin_walkEnd(
+    corto_entityAdmin *this,
+    corto_entityAdmin_reader *reader,
+    uint64_t visited)
+{
+    corto_entityAdmin_count(this, &reader->walks, 1);
+    corto_entityAdmin_count(this, &reader->visited, visited);
+
+    /* Stop announcing the epoch of the walk, so that a thread that doesn't
+     * read the admin again doesn't prevent reclaiming snapshots */
+    reader->walking --;
+    if (!reader->walking) {
+        corto_entityAdmin_announce(reader);
+    }
+}
+
+typedef struct corto_entityAdmin_walkData {
+    corto_entityWalkAction action;
+    corto_entityBatchAction batchAction;
+    void *userData;
+    uint64_t visited;
+} corto_entityAdmin_walkData;
+
+static
+int corto_entityAdmin_walkVisit(
+    corto_entitySeq *seq,
+    void *ctx)
+{
+    corto_entityAdmin_walkData *data = ctx;
+    uint32_t s;
+
+    for (s = 0; s < seq->length; s ++) {
+        corto_entity *entity = &seq->buffer[s];
+        if (!data->action(entity->e, entity->instance, data->userData)) {
+            data->visited += s + 1;
+            return 0;
+        }
+    }
+
+    data->visited += seq->length;
+    return 1;
+}
+
+static
+int corto_entityAdmin_walkBatchVisit(
+    corto_entitySeq *seq,
+    void *ctx)
+{
+    corto_entityAdmin_walkData *data = ctx;
+
+    if (seq->length) {
+        data->visited += seq->length;
+        return data->batchAction(seq->buffer, seq->length, data->userData);
+    }
+
+    return 1;
+}
+
 int corto_entityAdmin_walk(
     corto_entityAdmin *this,
     corto_entityWalkAction action,
@@ -138,58 +871,175 @@ int corto_entityAdmin_walk(
     bool recursive,
     void *userData)
 {
-    int result = 1;
-    int depthStart = 0;
-    int depthStop = CORTO_MAX_SCOPE_DEPTH;
-    int parentLength = 0;
-    if (parent) {
-         parentLength = strlen(parent);
-        if (!recursive) {
-            parentLength ++; /* Match null terminator */
+    corto_entityAdmin_walkData data = {action, NULL, userData, 0};
+    corto_entityAdmin_reader *reader;
+    corto_entityAdmin *admin = corto_entityAdmin_walkBegin(this, &reader);
+    int result;
+
+    if (!admin) {
+        return 0;
+    }
+
+    result = corto_entityAdmin_visit(
+        admin, parent, recursive, corto_entityAdmin_walkVisit, &data);
+
+    corto_entityAdmin_walkEnd(this, reader, data.visited);
+
+    return result;
+}
+
+int corto_entityAdmin_walkBatch(
+    corto_entityAdmin *this,
+    corto_entityBatchAction action,
+    const char *parent,
+    bool recursive,
+    void *userData)
+{
+    return corto_entityAdmin_walkBatchParallel(
+        this, action, parent, recursive, userData, 1);
+}
+
+/* Batches of a parallel walk, which are dispatched to workers. Workers take
+ * the next batch until all batches are done, or a batch returns 0. */
+typedef struct corto_entityAdmin_batchJob {
+    corto_entity **batches;
+    uint32_t *batchLengths;
+    uint32_t count;
+    uint32_t size;
+    uint64_t entities;
+    uint64_t visited;
+    uint32_t next;
+    int32_t stop;
+    corto_entityBatchAction action;
+    void *userData;
+} corto_entityAdmin_batchJob;
+
+static
+int corto_entityAdmin_batchCollect(
+    corto_entitySeq *seq,
+    void *ctx)
+{
+    corto_entityAdmin_batchJob *job = ctx;
+    uint32_t s;
+
+    /* Divide large parents, so they are spread over workers */
+    for (s = 0; s < seq->length; s += CORTO_ENTITYADMIN_BATCH_SIZE) {
+        uint32_t length = seq->length - s;
+        if (length > CORTO_ENTITYADMIN_BATCH_SIZE) {
+            length = CORTO_ENTITYADMIN_BATCH_SIZE;
         }
+
+        if (job->count == job->size) {
+            job->size = job->size ? job->size * 2 : 64;
+            job->batches = corto_realloc(
+                job->batches, job->size * sizeof(corto_entity*));
+            job->batchLengths = corto_realloc(
+                job->batchLengths, job->size * sizeof(uint32_t));
+        }
+
+        job->batches[job->count] = &seq->buffer[s];
+        job->batchLengths[job->count] = length;
+        job->count ++;
+        job->entities += length;
     }
 
-    if (this->count) {
-        corto_entityAdmin *admin = corto_entityAdmin_get(this);
-        if (!admin) {
-            corto_throw("failed to obtain entity admin");
-            return 0;
+    return 1;
+}
+
+static
+void corto_entityAdmin_batchRun(
+    void *arg)
+{
+    corto_entityAdmin_batchJob *job = arg;
+    uint64_t visited = 0;
+
+    while (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+        uint32_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) {
+            break;
         }
+        visited += job->batchLengths[i];
+        if (!job->action(job->batches[i], job->batchLengths[i], job->userData)) {
+            __atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+        }
+    }
 
-        if (parent) {
-            int depth = corto_entityAdmin_getDepthFromId(parent);
-            depthStart = depth;
-            if (!recursive) {
-                depthStop = depth + 1;
-            }
+    __atomic_add_fetch(&job->visited, visited, __ATOMIC_RELAXED);
+}
+
+int corto_entityAdmin_walkBatchParallel(
+    corto_entityAdmin *this,
+    corto_entityBatchAction action,
+    const char *parent,
+    bool recursive,
+    void *userData,
+    uint32_t workers)
+{
+    corto_entityAdmin_reader *reader;
+    corto_entityAdmin *admin = corto_entityAdmin_walkBegin(this, &reader);
+    uint64_t visited;
+    int result;
+    uint32_t i;
+
+    if (!admin) {
+        return 0;
+    }
+
+    uint32_t count = admin->count;
+    if (workers > count / CORTO_ENTITYADMIN_BATCH_MIN_WORKER_ENTITIES) {
+        workers = count / CORTO_ENTITYADMIN_BATCH_MIN_WORKER_ENTITIES;
+    }
+
+    if (workers <= 1) {
+        corto_entityAdmin_walkData data = {NULL, action, userData, 0};
+        result = corto_entityAdmin_visit(
+            admin, parent, recursive, corto_entityAdmin_walkBatchVisit, &data);
+        visited = data.visited;
+    } else {
+        corto_entityAdmin_batchJob job = {0};
+        job.action = action;
+        job.userData = userData;
+
+        corto_entityAdmin_visit(
+            admin, parent, recursive, corto_entityAdmin_batchCollect, &job);
+
+        /* Only the entities that are walked count */
+        if (workers > job.entities / CORTO_ENTITYADMIN_BATCH_MIN_WORKER_ENTITIES) {
+            workers = job.entities / CORTO_ENTITYADMIN_BATCH_MIN_WORKER_ENTITIES;
         }
 
-        int d, sp, s;
-        for (d = depthStart; d < depthStop; d++) {
-            for (sp = 0; sp < admin->entities[d].length; sp++) {
-                corto_entityPerParent *entityPerParent = &admin->entities[d].buffer[sp];
-                if (!entityPerParent->parent) {
-                    if (parent) {
-                        continue;
-                    }
-                } else {
-                    if (parent && strnicmp(entityPerParent->parent, parentLength, parent)) {
-                        continue;
-                    }
-                }
-                for (s = 0; s < entityPerParent->entities.length; s ++) {
-                    corto_entity *entity = &entityPerParent->entities.buffer[s];
-                    if (!(result = action(entity->e, entity->instance, userData))) {
-                        break;
-                    }
-                }
-            }
-            if (!result) {
+        /* Workers read from the snapshot of the calling thread, which remains
+         * valid until the walk ends. The calling thread runs batches too. */
+        corto_pool pool = corto_pool_default();
+        corto_pool_group group = {0};
+        if (!pool) {
+            /* Without a pool the calling thread runs all batches */
+            corto_catch();
+            workers = 1;
+        }
+        for (i = 1; i < workers; i ++) {
+            if (corto_pool_submit(
+                pool, &group, corto_entityAdmin_batchRun, &job))
+            {
+                corto_catch();
                 break;
             }
         }
+
+        corto_entityAdmin_batchRun(&job);
+        if (pool) {
+            corto_pool_wait(pool, &group);
+        }
+
+        result = !job.stop;
+        visited = job.visited;
+
+        corto_dealloc(job.batches);
+        corto_dealloc(job.batchLengths);
     }
 
+    corto_entityAdmin_walkEnd(this, reader, visited);
+
     return result;
 }
 
@@ -197,60 +1047,95 @@ int16_t corto_entityAdmin_add(
     corto_entityAdmin *this,
     const char *parent,
     void *e,
-    void *instance)
+    void *instance,
+    corto_entityHandle *handle_out)
 {
     if (!parent || !parent[0]) {
         parent = "/";
     }
 
     int16_t depth = corto_entityAdmin_getDepthFromId(parent);
+    if (depth >= CORTO_MAX_SCOPE_DEPTH) {
+        corto_throw("parent '%s' exceeds maximum scope depth", parent);
+        goto error;
+    }
+
+    /* Parents are interned, so they can be compared by pointer */
+    if (parent[0] != '/') {
+        char *tmp = corto_asprintf("/%s", parent);
+        parent = corto_strinterni(tmp);
+        corto_dealloc(tmp);
+    } else {
+        parent = corto_strinterni(parent);
+    }
+
+    if (!parent) {
+        goto error;
+    }
 
-    if (corto_rwmutex_write(&this->lock)) {
+    if (corto_entityAdmin_lock(this)) {
         goto error;
     }
 
     /* First, find an existing subscription sequence for parent of subscriber */
-    uint32_t sp;
+    corto_entityAdmin_scope *scope = corto_entityAdmin_scopeAdd(this, parent);
+    if (!scope) {
+        corto_rwmutex_unlock(&this->lock);
+        goto error;
+    }
+
+    int32_t sp = scope->index;
     corto_entityPerParent *entitiesPerParent = NULL;
-    for (sp = 0; sp < this->entities[depth].length; sp++) {
+    if (sp != -1) {
         entitiesPerParent = &this->entities[depth].buffer[sp];
-        if ((!parent && !entitiesPerParent->parent) ||
-            (parent && entitiesPerParent->parent && !stricmp(parent, entitiesPerParent->parent)))
-        {
-            break;
-        } else {
-            entitiesPerParent = NULL;
-        }
     }
 
     /* If no entity sequence is found for parent, create one */
     if (!entitiesPerParent) {
         uint32_t length = this->entities[depth].length + 1;
+        sp = length - 1;
+        __atomic_store_n(&scope->index, sp, __ATOMIC_RELAXED);
         this->entities[depth].buffer =
           corto_realloc(this->entities[depth].buffer, length * sizeof(corto_entityPerParent));
 
-        if (parent[0] != '/') {
-            this->entities[depth].buffer[length - 1].parent = corto_asprintf("/%s", parent);
-        } else {
-            this->entities[depth].buffer[length - 1].parent = strdup(parent);
-        }
-
+        this->entities[depth].buffer[length - 1].parent = parent;
         this->entities[depth].buffer[length - 1].entities.length = 0;
         this->entities[depth].buffer[length - 1].entities.buffer = NULL;
         this->entities[depth].length ++;
         entitiesPerParent = &this->entities[depth].buffer[length - 1];
+        if (depth >= this->depthCount) {
+            this->depthCount = depth + 1;
+        }
     }
 
     corto_entitySeq *seq = &entitiesPerParent->entities;
 
     /* Add subscriber to subscription sequence */
-    uint32_t length = seq->length + 1;
-    seq->buffer = corto_realloc(seq->buffer, length * sizeof(corto_entity));
-    seq->buffer[length - 1].e = e;
-    seq->buffer[length - 1].instance = instance;
+    if (seq->length == scope->size) {
+        scope->size = scope->size
+            ? scope->size * 2
+            : CORTO_ENTITYADMIN_MIN_ENTITIES;
+        seq->buffer = corto_realloc(seq->buffer, scope->size * sizeof(corto_entity));
+        scope->slots = corto_realloc(scope->slots, scope->size * sizeof(uint32_t));
+    }
+
+    uint32_t slot = corto_entityAdmin_slotNew(this, scope, seq->length);
+    scope->slots[seq->length] = slot;
+    seq->buffer[seq->length].e = e;
+    seq->buffer[seq->length].instance = instance;
     seq->length ++;
     this->count ++;
     this->changed ++;
+    if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+        this->stats.adds ++;
+    }
+
+    if (handle_out) {
+        *handle_out =
+            ((corto_entityHandle)this->slots[slot].generation << 32) | slot;
+    }
+
+    corto_entityAdmin_markDirty(this, scope);
 
     if (corto_rwmutex_unlock(&this->lock)) {
         goto error;
@@ -261,6 +1146,73 @@ error:
     return -1;
 }
 
+/* Remove entity at index from entities of parent, by moving the last entity
+ * of the parent in its place */
+static
+void corto_entityAdmin_removeAt(
+    corto_entityAdmin *this,
+    corto_entityAdmin_scope *scope,
+    corto_entitySeq *seq,
+    uint32_t s)
+{
+    uint32_t last = seq->length - 1;
+
+    corto_entityAdmin_markDirty(this, scope);
+    corto_entityAdmin_slotFree(this, scope->slots[s]);
+    if (s != last) {
+        seq->buffer[s] = seq->buffer[last];
+        scope->slots[s] = scope->slots[last];
+        this->slots[scope->slots[s]].index = s;
+    }
+
+    seq->length --;
+    this->count --;
+    if (__atomic_load_n(&this->collectStats, __ATOMIC_RELAXED)) {
+        this->stats.removes ++;
+    }
+}
+
+/* Remove entity from entities of parent. Scope may be NULL if it is not known
+ * yet. Returns number of removed entities. */
+static
+int32_t corto_entityAdmin_removeFromParent(
+    corto_entityAdmin *this,
+    corto_entityAdmin_scope *scope,
+    int16_t depth,
+    uint32_t sp,
+    void *e,
+    void *instance,
+    bool removeAll)
+{
+    corto_entityPerParent *entitiesPerParent = &this->entities[depth].buffer[sp];
+    corto_entitySeq *seq = &entitiesPerParent->entities;
+    int32_t count = 0;
+    uint32_t s = 0;
+
+    while (s < seq->length) {
+        corto_entity *sub = &seq->buffer[s];
+        if ((sub->e == e) && (removeAll || (sub->instance == instance))) {
+            if (!scope) {
+                scope = corto_entityAdmin_indexFind(
+                    this,
+                    entitiesPerParent->parent,
+                    strihash(entitiesPerParent->parent));
+            }
+
+            /* Last entity is moved to s, so s is checked again */
+            corto_entityAdmin_removeAt(this, scope, seq, s);
+            count ++;
+            if (!removeAll) {
+                break;
+            }
+        } else {
+            s ++;
+        }
+    }
+
+    return count;
+}
+
 int corto_entityAdmin_remove(
     corto_entityAdmin *this,
     const char *parent,
@@ -268,43 +1220,39 @@ int corto_entityAdmin_remove(
     void *instance,
     bool removeAll)
 {
-    int32_t count = 0;
+    corto_entityAdmin_scope *scope;
+    int32_t count = 0, sp;
     int16_t depth = corto_entityAdmin_getDepthFromId(parent);
+    char *tmp = NULL;
 
-    if (corto_rwmutex_write(&this->lock)) {
+    if (!parent || !parent[0]) {
+        parent = "/";
+    } else if (parent[0] != '/') {
+        parent = tmp = corto_asprintf("/%s", parent);
+    }
+
+    if (corto_entityAdmin_lock(this)) {
         goto error;
     }
 
-    /* Find subscriber */
-    uint32_t s, sp;
-    for (sp = 0; sp < this->entities[depth].length; sp++) {
-        corto_entityPerParent *entitiesPerParent = &this->entities[depth].buffer[sp];
-        corto_entitySeq *seq = &entitiesPerParent->entities;
-        for (s = 0; s < seq->length; s ++) {
-            corto_entity *sub = &seq->buffer[s];
-            if ((sub->e == e) && (removeAll || (sub->instance == instance))) {
-                if (s == (seq->length - 1)) {
-                    seq->buffer[s].e = NULL;
-                    seq->buffer[s].instance = NULL;
-                } else {
-                    seq->buffer[s].e = seq->buffer[seq->length - 1].e;
-                    seq->buffer[s].instance = seq->buffer[seq->length - 1].instance;
-
-                    /* If removing all, make sure not to skip elements */
-                    if (removeAll && (s == (seq->length - 2))) {
-                        s --;
-                    }
-                }
+    /* Find subscriber in entities of parent */
+    if (!removeAll) {
+        scope = corto_entityAdmin_indexFind(this, parent, strihash(parent));
+        if (scope && ((sp = scope->index) != -1)) {
+            count = corto_entityAdmin_removeFromParent(
+                this, scope, depth, sp, e, instance, removeAll);
+        }
+    }
 
-                seq->length --;
-                this->count --;
-                count ++;
-                if (!removeAll) {
-                    break;
-                }
-            }
+    /* If subscriber is not found in parent, or when removing all, find
+     * subscriber in all parents at the same depth */
+    if (!count && (depth < this->depthCount)) {
+        for (sp = 0; (uint32_t)sp < this->entities[depth].length; sp++) {
+            count += corto_entityAdmin_removeFromParent(
+                this, NULL, depth, sp, e, instance, removeAll);
         }
     }
+
     if (!count && !removeAll) {
         corto_throw(
           "unsubscribe failed, could not find entity for instance <%p>", instance);
@@ -319,8 +1267,152 @@ int corto_entityAdmin_remove(
         goto error;
     }
 
+    corto_dealloc(tmp);
     return count;
 error:
     corto_rwmutex_unlock(&this->lock);
+    corto_dealloc(tmp);
+    return -1;
+}
+
+int16_t corto_entityAdmin_removeHandle(
+    corto_entityAdmin *this,
+    corto_entityHandle handle)
+{
+    uint32_t slot = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+
+    if (corto_entityAdmin_lock(this)) {
+        goto error;
+    }
+
+    if ((slot >= this->slotCount) ||
+        !this->slots[slot].scope ||
+        (this->slots[slot].generation != generation))
+    {
+        corto_throw("invalid entity handle %llx", (unsigned long long)handle);
+        corto_rwmutex_unlock(&this->lock);
+        goto error;
+    }
+
+    corto_entityAdmin_scope *scope = this->slots[slot].scope;
+    corto_entityAdmin_removeAt(
+        this,
+        scope,
+        &this->entities[scope->depth].buffer[scope->index].entities,
+        this->slots[slot].index);
+    this->changed ++;
+
+    if (corto_rwmutex_unlock(&this->lock)) {
+        goto error;
+    }
+
+    return 0;
+error:
     return -1;
 }
+
+/* Get memory used by scope and the scopes in it */
+static
+void corto_entityAdmin_scopeMemory(
+    corto_entityAdmin_scope *scope,
+    corto_entityAdmin_memory_t *memory)
+{
+    corto_entityAdmin_scope *child;
+
+    memory->entities += scope->size * sizeof(corto_entity);
+    memory->scopes += sizeof(corto_entityAdmin_scope) +
+        scope->size * sizeof(uint32_t);
+
+    for (child = scope->scopes; child; child = child->next) {
+        corto_entityAdmin_scopeMemory(child, memory);
+    }
+}
+
+void corto_entityAdmin_memory(
+    corto_entityAdmin *this,
+    corto_entityAdmin_memory_t *memory_out)
+{
+    corto_entityAdmin_reader *reader;
+    corto_entityAdmin *snapshot;
+    int32_t d;
+    uint32_t sp;
+
+    memset(memory_out, 0, sizeof(corto_entityAdmin_memory_t));
+
+    if (corto_rwmutex_read(&this->lock)) {
+        corto_throw(NULL);
+        return;
+    }
+
+    memory_out->depthCount = this->depthCount;
+
+    for (d = 0; d < this->depthCount; d ++) {
+        memory_out->entities +=
+            this->entities[d].length * sizeof(corto_entityPerParent);
+    }
+    if (this->root) {
+        corto_entityAdmin_scopeMemory(this->root, memory_out);
+    }
+    if (this->index) {
+        memory_out->scopes += sizeof(corto_entityAdmin_index) +
+            this->index->size * sizeof(corto_entityAdmin_indexEntry);
+    }
+
+    memory_out->handles = this->slotSize * sizeof(corto_entityAdmin_slot);
+    memory_out->scopes += this->dirtySize * sizeof(corto_entityAdmin_scope*);
+
+    for (reader = this->readers; reader; reader = reader->next) {
+        memory_out->readers += sizeof(corto_entityAdmin_reader);
+    }
+
+    /* Snapshots don't share buffers with the admin. A retired snapshot owns
+     * the buffers that were replaced by the next snapshot. */
+    if ((snapshot = this->snapshot)) {
+        memory_out->snapshot = sizeof(corto_entityAdmin);
+        for (d = 0; d < snapshot->depthCount; d ++) {
+            corto_entityPerParentSeq *parents = &snapshot->entities[d];
+            memory_out->snapshot +=
+                parents->length * sizeof(corto_entityPerParent);
+            for (sp = 0; sp < parents->length; sp ++) {
+                memory_out->snapshot += parents->buffer[sp].entities.length *
+                    sizeof(corto_entity);
+            }
+        }
+    }
+
+    for (snapshot = this->retired; snapshot; snapshot = snapshot->retired) {
+        memory_out->retired ++;
+        memory_out->retiredBytes += sizeof(corto_entityAdmin) +
+            snapshot->garbageCount * sizeof(void*) + snapshot->garbageBytes;
+    }
+
+    memory_out->total = memory_out->entities + memory_out->scopes +
+        memory_out->handles + memory_out->readers + memory_out->snapshot +
+        memory_out->retiredBytes;
+
+    corto_rwmutex_unlock(&this->lock);
+}
+
+void corto_entityAdmin_stats(
+    corto_entityAdmin *this,
+    corto_entityAdmin_stats_t *stats_out)
+{
+    corto_entityAdmin_reader *reader;
+
+    if (corto_rwmutex_read(&this->lock)) {
+        corto_throw(NULL);
+        return;
+    }
+
+    *stats_out = this->stats;
+
+    for (reader = this->readers; reader; reader = reader->next) {
+        stats_out->gets += __atomic_load_n(&reader->gets, __ATOMIC_RELAXED);
+        stats_out->walks += __atomic_load_n(&reader->walks, __ATOMIC_RELAXED);
+        stats_out->visited +=
+            __atomic_load_n(&reader->visited, __ATOMIC_RELAXED);
+    }
+
+    corto_rwmutex_unlock(&this->lock);
+}
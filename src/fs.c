@@ -599,6 +599,18 @@ void corto_dir_releaseRecursiveFilter(
     corto_ll_iterRelease(it);
 }
 
+static
+void corto_dir_freeCollected(
+    char **paths,
+    uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i < count; i ++) {
+        corto_dealloc(paths[i]);
+    }
+    corto_dealloc(paths);
+}
+
 static
 int16_t corto_dir_collectRecursive(
     const char *name,
@@ -607,6 +619,9 @@ int16_t corto_dir_collectRecursive(
     corto_ll files)
 {
     corto_iter it;
+    char **paths = NULL;
+    uint64_t *matched = NULL;
+    uint32_t count = 0, size = 0, i;
 
     /* Move to current directory */
     if (name && name[0]) {
@@ -620,18 +635,42 @@ int16_t corto_dir_collectRecursive(
         goto error;
     }
 
+    /* Collect files of directory, so they can be matched in a single batch */
     while (corto_iter_hasNext(&it)) {
         char *file = corto_iter_next(&it);
 
-        /* Add file to results if it matches filter */
+        if (count == size) {
+            size = size ? size * 2 : 32;
+            paths = corto_realloc(paths, size * sizeof(char*));
+        }
+
         char *path = corto_asprintf("%s/%s", corto_dirstack_wd(stack), file);
         corto_path_clean(path, path);
-        if (corto_idmatch_run(filter, path)) {
-            corto_ll_append(files, path);
+        paths[count] = path;
+        count ++;
+    }
+    corto_iter_release(&it);
+
+    if (count) {
+        matched = corto_alloc(((count + 63) / 64) * sizeof(uint64_t));
+        corto_idmatch_runBatch(filter, (const char**)paths, count, matched);
+    }
+
+    for (i = 0; i < count; i ++) {
+        /* Filename is the last element of the path. If the path is added to
+         * the results it is owned by the list, which keeps it alive. */
+        const char *file = strrchr(paths[i], '/');
+        bool crawl = corto_idmatch_canMatchUnder(filter, paths[i]);
+        file = file ? file + 1 : paths[i];
+
+        /* Add file to results if it matches filter */
+        if (matched[i / 64] & (1ull << (i % 64))) {
+            corto_ll_append(files, paths[i]);
+            paths[i] = NULL;
         }
 
-        /* If directory, crawl */
-        if (corto_isdir(file)) {
+        /* If directory that can contain matching files, crawl */
+        if (crawl && corto_isdir(file)) {
             if (corto_dir_collectRecursive(file, stack, filter, files)) {
                 goto error;
             }
@@ -642,8 +681,13 @@ int16_t corto_dir_collectRecursive(
         corto_dirstack_pop(stack);
     }
 
+    corto_dir_freeCollected(paths, count);
+    corto_dealloc(matched);
+
     return 0;
 error:
+    corto_dir_freeCollected(paths, count);
+    corto_dealloc(matched);
     corto_assert(corto_dirstack_pop(stack) == 0, "previous directory vanished");
 stack_error:
     return -1;
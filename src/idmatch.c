@@ -21,6 +21,7 @@
 
 
 #include "idmatch.h"
+#include "simd.h"
 
 static char* corto_idmatchTokenStr(corto_idmatchToken t) {
     switch(t) {
@@ -39,12 +40,12 @@ static char* corto_idmatchTokenStr(corto_idmatchToken t) {
     return NULL;
 }
 
-static int corto_idmatchValidate(corto_idmatch_program data) {
+static int corto_idmatchValidate(corto_idmatchOp *ops, int32_t size) {
     int op;
 
     corto_idmatchToken t = CORTO_MATCHER_TOKEN_NONE, tprev = CORTO_MATCHER_TOKEN_NONE;
-    for (op = 0; op < data->size; op++) {
-        t = data->ops[op].token;
+    for (op = 0; op < size; op++) {
+        t = ops[op].token;
         switch(t) {
         case CORTO_MATCHER_TOKEN_AND:
             switch(tprev) {
@@ -188,8 +189,24 @@ bool corto_idmatch_hasOperators(
     return false;
 }
 
-int16_t corto_idmatchParseIntern(
-    corto_idmatch_program data,
+/* Each character of an expression results in at most one op, and a '*' filter
+ * is added before each separator and at the end. One op is reserved for the
+ * closing NONE, and one for the start of the op after the last character. */
+#define CORTO_IDMATCH_PARSE_MAX_OPS(length, separators) \
+    ((length) + (separators) + 3)
+
+/* Expressions up to this size are parsed in buffers on the stack */
+#define CORTO_IDMATCH_PARSE_STACK_OPS (64)
+#define CORTO_IDMATCH_PARSE_STACK_TOKENS (256)
+
+/* Parse lowercase copy of expression into ops. Tokens are terminated by
+ * writing null characters into the copy. The ops array must have room for
+ * CORTO_IDMATCH_PARSE_MAX_OPS ops. Returns the number of ops, or -1 if the
+ * expression is invalid. */
+static
+int32_t corto_idmatch_parse(
+    corto_idmatchOp *ops,
+    char *tokens,
     const char *expr,
     bool allowScopes,
     bool allowSeparators)
@@ -197,15 +214,10 @@ int16_t corto_idmatchParseIntern(
     char *ptr, *start, ch;
     int op = 0;
 
-    data->size = 0;
-    data->kind = 0;
-    data->tokens = corto_strdup(expr);
-    strlower(data->tokens);
-
-    ptr = data->tokens;
-    for (; (ch = *ptr); data->ops[op].start = ptr, ptr++) {
-        data->ops[op].containsWildcard = FALSE;
-        data->ops[op].start = NULL;
+    ptr = tokens;
+    for (; (ch = *ptr); ops[op].start = ptr, ptr++) {
+        ops[op].containsWildcard = FALSE;
+        ops[op].start = NULL;
         start = ptr;
         switch(ch) {
         case '/':
@@ -214,12 +226,12 @@ int16_t corto_idmatchParseIntern(
                 goto error;
             }
             if (ptr[1] == '/') {
-                data->ops[op].token = CORTO_MATCHER_TOKEN_TREE;
+                ops[op].token = CORTO_MATCHER_TOKEN_TREE;
                 *ptr = '\0';
                 ptr++;
             } else {
                 *ptr = '\0';
-                data->ops[op].token = CORTO_MATCHER_TOKEN_SCOPE;
+                ops[op].token = CORTO_MATCHER_TOKEN_SCOPE;
             }
             break;
         case ':':
@@ -228,7 +240,7 @@ int16_t corto_idmatchParseIntern(
                 goto error;
             }
             if (ptr[1] == ':') {
-                data->ops[op].token = CORTO_MATCHER_TOKEN_SCOPE;
+                ops[op].token = CORTO_MATCHER_TOKEN_SCOPE;
                 *ptr = '\0';
                 ptr++;
             } else {
@@ -237,15 +249,15 @@ int16_t corto_idmatchParseIntern(
             }
             break;
         case '|':
-            data->ops[op].token = CORTO_MATCHER_TOKEN_OR;
+            ops[op].token = CORTO_MATCHER_TOKEN_OR;
             *ptr = '\0';
             break;
         case '&':
-            data->ops[op].token = CORTO_MATCHER_TOKEN_AND;
+            ops[op].token = CORTO_MATCHER_TOKEN_AND;
             *ptr = '\0';
             break;
         case '^':
-            data->ops[op].token = CORTO_MATCHER_TOKEN_NOT;
+            ops[op].token = CORTO_MATCHER_TOKEN_NOT;
             *ptr = '\0';
             break;
         case ',':
@@ -253,7 +265,18 @@ int16_t corto_idmatchParseIntern(
                 corto_throw("scope operators not allowed");
                 goto error;
             }
-            data->ops[op].token = CORTO_MATCHER_TOKEN_SEPARATOR;
+            /* If alternative ends with scope or tree, append '*' */
+            if (op &&
+               ((ops[op - 1].token == CORTO_MATCHER_TOKEN_SCOPE) ||
+                (ops[op - 1].token == CORTO_MATCHER_TOKEN_TREE)))
+            {
+                ops[op].token = CORTO_MATCHER_TOKEN_FILTER;
+                ops[op].start = "*";
+                op ++;
+                ops[op].containsWildcard = FALSE;
+                ops[op].start = NULL;
+            }
+            ops[op].token = CORTO_MATCHER_TOKEN_SEPARATOR;
             *ptr = '\0';
             break;
         case '.':
@@ -263,18 +286,18 @@ int16_t corto_idmatchParseIntern(
             }
             if (ptr[1] == '.') {
                 if ((op < 4) ||
-                    ((data->ops[op - 2].token == CORTO_MATCHER_TOKEN_PARENT) &&
-                     (data->ops[op - 1].token == CORTO_MATCHER_TOKEN_SCOPE)))
+                    ((ops[op - 2].token == CORTO_MATCHER_TOKEN_PARENT) &&
+                     (ops[op - 1].token == CORTO_MATCHER_TOKEN_SCOPE)))
                 {
-                    data->ops[op].token = CORTO_MATCHER_TOKEN_PARENT;
+                    ops[op].token = CORTO_MATCHER_TOKEN_PARENT;
                 } else {
                     op -= 4;
                 }
                 *ptr = '\0';
                 ptr++;
             } else {
-                if ((op < 2) || (data->ops[op - 1].token != CORTO_MATCHER_TOKEN_SCOPE)) {
-                    data->ops[op].token = CORTO_MATCHER_TOKEN_THIS;
+                if ((op < 2) || (ops[op - 1].token != CORTO_MATCHER_TOKEN_SCOPE)) {
+                    ops[op].token = CORTO_MATCHER_TOKEN_THIS;
                 } else {
                     op -= 2;
                 }
@@ -282,14 +305,14 @@ int16_t corto_idmatchParseIntern(
             }
             break;
         default:
-            data->ops[op].token = CORTO_MATCHER_TOKEN_IDENTIFIER;
+            ops[op].token = CORTO_MATCHER_TOKEN_IDENTIFIER;
             while((ch = *ptr++) &&
                   (isalnum(ch) || (ch == '_') || (ch == '*') || (ch == '?') ||
                     (ch == '(') || (ch == ')') || (ch == '{') || (ch == '}') ||
                     (ch == ' ') || (ch == '$') || (ch == '.')))
             {
                 if ((ch == '*') || (ch == '?')) {
-                    data->ops[op].token = CORTO_MATCHER_TOKEN_FILTER;
+                    ops[op].token = CORTO_MATCHER_TOKEN_FILTER;
                 }
             }
 
@@ -302,57 +325,954 @@ int16_t corto_idmatchParseIntern(
             break;
         }
 
-        if (!data->ops[op].start) {
-            data->ops[op].start = start;
-        }
-        if (++op == (CORTO_MATCHER_MAX_OP - 2)) {
-            corto_throw("expression contains too many tokens");
-            goto error;
+        if (!ops[op].start) {
+            ops[op].start = start;
         }
+        op ++;
     }
 
     if (op) {
         /* If expression ends with scope or tree, append '*' */
-        if ((data->ops[op - 1].token == CORTO_MATCHER_TOKEN_SCOPE) ||
-            (data->ops[op - 1].token == CORTO_MATCHER_TOKEN_TREE))
+        if ((ops[op - 1].token == CORTO_MATCHER_TOKEN_SCOPE) ||
+            (ops[op - 1].token == CORTO_MATCHER_TOKEN_TREE))
+        {
+            ops[op].token = CORTO_MATCHER_TOKEN_FILTER;
+            ops[op].start = "*";
+            op ++;
+        }
+        if (corto_idmatchValidate(ops, op)) {
+            goto error;
+        }
+    }
+
+    return op;
+error:
+    return -1;
+}
+
+/* Create program from ops that point into tokens, or to string literals. The
+ * program, ops and tokens are stored in a single allocation. */
+static
+corto_idmatch_program corto_idmatch_programNew(
+    corto_idmatchOp *ops,
+    int32_t size,
+    const char *tokens,
+    size_t length)
+{
+    corto_idmatch_program result;
+    int32_t i;
+
+    result = corto_alloc(sizeof(struct corto_idmatch_program_s) +
+        (size + 1) * sizeof(corto_idmatchOp) + length + 1);
+    result->kind = 0;
+    result->size = size;
+    result->dfa = NULL;
+    result->literal = NULL;
+    result->literalLength = 0;
+    result->idset = NULL;
+    result->tokens = (char*)&result->ops[size + 1];
+    result->tokensLength = length + 1;
+    memcpy(result->tokens, tokens, length + 1);
+
+    /* Move pointers to tokens to the copy in the program */
+    for (i = 0; i < size; i ++) {
+        const char *start = ops[i].start;
+        result->ops[i] = ops[i];
+        if (((uintptr_t)start >= (uintptr_t)tokens) &&
+            ((uintptr_t)start <= (uintptr_t)&tokens[length]))
+        {
+            result->ops[i].start = &result->tokens[start - tokens];
+        }
+    }
+    result->ops[size].token = CORTO_MATCHER_TOKEN_NONE; /* Close with NONE */
+    result->ops[size].start = NULL;
+    result->ops[size].containsWildcard = FALSE;
+
+    return result;
+}
+
+corto_idmatch_program corto_idmatchParseIntern(
+    const char *expr,
+    bool allowScopes,
+    bool allowSeparators)
+{
+    corto_idmatchOp stackOps[CORTO_IDMATCH_PARSE_STACK_OPS], *ops = stackOps;
+    char stackTokens[CORTO_IDMATCH_PARSE_STACK_TOKENS], *tokens = stackTokens;
+    corto_idmatch_program result = NULL;
+    size_t length = strlen(expr), separators = 0;
+    const char *ptr;
+    int32_t size;
+
+    for (ptr = expr; (ptr = strchr(ptr, ',')); ptr ++) {
+        separators ++;
+    }
+
+    size_t maxOps = CORTO_IDMATCH_PARSE_MAX_OPS(length, separators);
+    if (maxOps > CORTO_IDMATCH_PARSE_STACK_OPS) {
+        ops = corto_alloc(maxOps * sizeof(corto_idmatchOp));
+    }
+    if (length >= CORTO_IDMATCH_PARSE_STACK_TOKENS) {
+        tokens = corto_alloc(length + 1);
+    }
+    memcpy(tokens, expr, length + 1);
+    strlower(tokens);
+
+    if ((size = corto_idmatch_parse(
+        ops, tokens, expr, allowScopes, allowSeparators)) < 0)
+    {
+        goto error;
+    }
+
+    result = corto_idmatch_programNew(ops, size, tokens, length);
+
+error:
+    if (ops != stackOps) {
+        corto_dealloc(ops);
+    }
+    if (tokens != stackTokens) {
+        corto_dealloc(tokens);
+    }
+    return result;
+}
+
+bool corto_idmatch_glob(
+    const char *pattern,
+    corto_strview str)
+{
+    const char *ptr = pattern, *star = NULL;
+    size_t i = 0, starPos = 0;
+
+    while (i < str.len) {
+        char ch = *ptr;
+        if (ch == '*') {
+            star = ++ ptr;
+            starPos = i;
+        } else if (ch && ((ch == '?') || (ch == tolower((uint8_t)str.ptr[i])))) {
+            ptr ++;
+            i ++;
+        } else if (star) {
+            /* Let the last '*' match one more character */
+            ptr = star;
+            i = ++ starPos;
+        } else {
+            return false;
+        }
+    }
+
+    while (*ptr == '*') {
+        ptr ++;
+    }
+
+    return !*ptr;
+}
+
+/* -- Automaton --
+ * Programs that only consist of identifiers, filters, scopes, trees and
+ * separators describe a regular language over the characters of an id. These
+ * programs are compiled to a Thompson NFA, which is converted to a DFA with the
+ * subset construction. The resulting automaton matches an id in a single pass,
+ * without splitting or copying the id.
+ *
+ * The automaton implements the same rules as the interpreter:
+ * - elements that start with a '.' never match an identifier or filter
+ * - a tree operator matches zero or more arbitrary elements
+ * - a leading scope operator in an alternative is ignored */
+
+typedef enum corto_idmatchNfaKind {
+    CORTO_IDMATCH_NFA_CHAR,          /* Match ch */
+    CORTO_IDMATCH_NFA_NOSLASH,       /* Match any character but '/' */
+    CORTO_IDMATCH_NFA_NOSLASH_NODOT, /* Match any character but '/' and '.' */
+    CORTO_IDMATCH_NFA_SPLIT,         /* Continue with out and out1 */
+    CORTO_IDMATCH_NFA_MATCH          /* Id matches */
+} corto_idmatchNfaKind;
+
+typedef struct corto_idmatchNfaState {
+    corto_idmatchNfaKind kind;
+    char ch;
+    int32_t out;  /* -1 if state has no successor */
+    int32_t out1;
+} corto_idmatchNfaState;
+
+typedef struct corto_idmatchNfa {
+    corto_idmatchNfaState *states;
+    int32_t count;
+    int32_t size;
+    int32_t *start;
+    int32_t startCount;
+} corto_idmatchNfa;
+
+/* Adding a state may move the states array, so the result must be stored in a
+ * local before it is assigned to a field of another state. */
+static
+int32_t corto_idmatchNfa_add(
+    corto_idmatchNfa *nfa,
+    corto_idmatchNfaKind kind,
+    char ch,
+    int32_t out,
+    int32_t out1)
+{
+    if (nfa->count == nfa->size) {
+        nfa->size = nfa->size ? nfa->size * 2 : 32;
+        nfa->states = corto_realloc(
+            nfa->states, nfa->size * sizeof(corto_idmatchNfaState));
+    }
+    corto_idmatchNfaState *state = &nfa->states[nfa->count];
+    state->kind = kind;
+    state->ch = ch;
+    state->out = out;
+    state->out1 = out1;
+    return nfa->count ++;
+}
+
+/* Add states for a glob element, followed by state cont. Returns the first
+ * state of the element, or -1 if the element can never match. Characters
+ * matched before anything else in the element (the leading '*'s and the first
+ * character after them) may not match a '.'. */
+static
+int32_t corto_idmatchNfa_glob(
+    corto_idmatchNfa *nfa,
+    const char *glob,
+    int32_t cont)
+{
+    int32_t i, len = strlen(glob), stars = 0, state = cont;
+    int32_t first, firstPristine;
+
+    while (glob[stars] == '*') {
+        stars ++;
+    }
+
+    for (i = len - 1; i > stars; i --) {
+        char ch = glob[i];
+        if (ch == '*') {
+            int32_t split = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_SPLIT, 0, state, -1);
+            int32_t any = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_NOSLASH, 0, split, -1);
+            nfa->states[split].out1 = any;
+            state = split;
+        } else if (ch == '?') {
+            state = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_NOSLASH, 0, state, -1);
+        } else {
+            state = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_CHAR, ch, state, -1);
+        }
+    }
+
+    if (stars < len) {
+        char ch = glob[stars];
+        if (ch == '?') {
+            first = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_NOSLASH, 0, state, -1);
+            firstPristine = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_NOSLASH_NODOT, 0, state, -1);
+        } else {
+            first = corto_idmatchNfa_add(
+                nfa, CORTO_IDMATCH_NFA_CHAR, ch, state, -1);
+            firstPristine = (ch == '.') ? -1 : first;
+        }
+    } else {
+        first = firstPristine = state;
+    }
+
+    if (!stars) {
+        return firstPristine;
+    }
+
+    /* Once the leading '*' matched a character, the element no longer
+     * starts with a '.' */
+    int32_t loop = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_SPLIT, 0, first, -1);
+    int32_t any = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_NOSLASH, 0, loop, -1);
+    nfa->states[loop].out1 = any;
+    int32_t leading = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_NOSLASH_NODOT, 0, loop, -1);
+    return corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_SPLIT, 0, firstPristine, leading);
+}
+
+/* Add states that match zero or more elements, each followed by a '/' */
+static
+int32_t corto_idmatchNfa_gap(
+    corto_idmatchNfa *nfa,
+    int32_t cont)
+{
+    int32_t gap = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_SPLIT, 0, cont, -1);
+    int32_t elem = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_SPLIT, 0, -1, -1);
+    int32_t sep = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_CHAR, '/', gap, -1);
+    nfa->states[elem].out = sep;
+    int32_t any = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_NOSLASH, 0, elem, -1);
+    nfa->states[elem].out1 = any;
+    nfa->states[gap].out1 = elem;
+    return gap;
+}
+
+/* Add states for an alternative, which starts at op and ends before end */
+static
+int16_t corto_idmatchNfa_alternative(
+    corto_idmatchNfa *nfa,
+    corto_idmatchOp *op,
+    corto_idmatchOp *end,
+    int32_t match)
+{
+    int32_t state = match;
+    corto_idmatchOp *cur;
+
+    if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        op ++;
+    }
+
+    /* Alternatives must end with an element, which is guaranteed by parser */
+    if ((end == op) ||
+        ((end[-1].token != CORTO_MATCHER_TOKEN_IDENTIFIER) &&
+         (end[-1].token != CORTO_MATCHER_TOKEN_FILTER)))
+    {
+        goto unsupported;
+    }
+
+    /* Build states from the last element to the first */
+    for (cur = end - 1; cur >= op; cur --) {
+        switch(cur->token) {
+        case CORTO_MATCHER_TOKEN_IDENTIFIER:
+        case CORTO_MATCHER_TOKEN_FILTER:
+            if (state != -1) {
+                state = corto_idmatchNfa_glob(nfa, cur->start, state);
+            }
+            break;
+        case CORTO_MATCHER_TOKEN_SCOPE:
+            if (cur == op) {
+                goto unsupported;
+            }
+            if (state != -1) {
+                state = corto_idmatchNfa_add(
+                    nfa, CORTO_IDMATCH_NFA_CHAR, '/', state, -1);
+            }
+            break;
+        case CORTO_MATCHER_TOKEN_TREE:
+            if (state != -1) {
+                state = corto_idmatchNfa_gap(nfa, state);
+                if (cur != op) {
+                    state = corto_idmatchNfa_add(
+                        nfa, CORTO_IDMATCH_NFA_CHAR, '/', state, -1);
+                }
+            }
+            break;
+        default:
+            goto unsupported;
+        }
+    }
+
+    if (state != -1) {
+        nfa->start = corto_realloc(
+            nfa->start, (nfa->startCount + 1) * sizeof(int32_t));
+        nfa->start[nfa->startCount ++] = state;
+    }
+
+    return 0;
+unsupported:
+    return -1;
+}
+
+static
+int16_t corto_idmatchNfa_build(
+    corto_idmatchNfa *nfa,
+    corto_idmatch_program program)
+{
+    corto_idmatchOp *op = program->ops, *end = op;
+    int32_t match = corto_idmatchNfa_add(
+        nfa, CORTO_IDMATCH_NFA_MATCH, 0, -1, -1);
+
+    do {
+        while ((end->token != CORTO_MATCHER_TOKEN_NONE) &&
+               (end->token != CORTO_MATCHER_TOKEN_SEPARATOR))
+        {
+            end ++;
+        }
+        if (corto_idmatchNfa_alternative(nfa, op, end, match)) {
+            goto unsupported;
+        }
+        op = end + 1;
+    } while ((end ++)->token == CORTO_MATCHER_TOKEN_SEPARATOR);
+
+    return 0;
+unsupported:
+    return -1;
+}
+
+/* Add state and all states reachable through SPLIT states to set */
+static
+void corto_idmatchNfa_closure(
+    corto_idmatchNfa *nfa,
+    uint8_t *set,
+    int32_t state)
+{
+    while (state != -1 && !set[state]) {
+        set[state] = 1;
+        if (nfa->states[state].kind != CORTO_IDMATCH_NFA_SPLIT) {
+            break;
+        }
+        corto_idmatchNfa_closure(nfa, set, nfa->states[state].out1);
+        state = nfa->states[state].out;
+    }
+}
+
+static
+bool corto_idmatchNfa_accepts(
+    corto_idmatchNfaState *state,
+    uint8_t ch)
+{
+    switch(state->kind) {
+    case CORTO_IDMATCH_NFA_CHAR:
+        return (uint8_t)state->ch == ch;
+    case CORTO_IDMATCH_NFA_NOSLASH:
+        return ch != '/';
+    case CORTO_IDMATCH_NFA_NOSLASH_NODOT:
+        return (ch != '/') && (ch != '.');
+    default:
+        return false;
+    }
+}
+
+static
+void corto_idmatch_dfaFree(
+    corto_idmatch_dfa *dfa)
+{
+    if (dfa) {
+        corto_dealloc(dfa->next);
+        corto_dealloc(dfa->accept);
+        corto_dealloc(dfa->live);
+        corto_dealloc(dfa);
+    }
+}
+
+/* Convert program to DFA. Returns NULL if the program contains operators that
+ * can't be expressed by the automaton, or when the automaton would require more
+ * than CORTO_IDMATCH_MAX_DFA_STATE states. */
+static
+corto_idmatch_dfa* corto_idmatch_dfaCompile(
+    corto_idmatch_program program)
+{
+    corto_idmatchNfa nfa = {NULL, 0, 0, NULL, 0};
+    corto_idmatch_dfa *dfa = NULL;
+    uint8_t *sets = NULL, *set = NULL;
+    uint8_t representative[256];
+    int32_t i, s, c, cl;
+    bool changed;
+
+    if (corto_idmatchNfa_build(&nfa, program)) {
+        goto unsupported;
+    }
+
+    dfa = corto_calloc(sizeof(corto_idmatch_dfa));
+
+    /* Characters that appear in the pattern, '/' and '.' each get their own
+     * class. All other characters share class 0. */
+    dfa->classCount = 1;
+    for (i = 0; i < nfa.count; i ++) {
+        uint8_t ch = nfa.states[i].ch;
+        if (nfa.states[i].kind != CORTO_IDMATCH_NFA_CHAR) {
+            continue;
+        }
+        ch = tolower(ch);
+        if (!dfa->classes[ch]) {
+            representative[dfa->classCount] = ch;
+            dfa->classes[ch] = dfa->classCount ++;
+        }
+    }
+    for (i = 0; i < 2; i ++) {
+        uint8_t ch = i ? '/' : '.';
+        if (!dfa->classes[ch]) {
+            representative[dfa->classCount] = ch;
+            dfa->classes[ch] = dfa->classCount ++;
+        }
+    }
+    for (i = 'A'; i <= 'Z'; i ++) {
+        dfa->classes[i] = dfa->classes[tolower(i)];
+    }
+    for (i = 1; i < 256; i ++) {
+        if (!dfa->classes[i] && !dfa->classes[tolower(i)]) {
+            representative[0] = i;
+            break;
+        }
+    }
+
+    /* Subset construction. Each DFA state is identified by the set of NFA
+     * states it represents. */
+    sets = corto_calloc(CORTO_IDMATCH_MAX_DFA_STATE * nfa.count);
+    dfa->next = corto_alloc(
+        CORTO_IDMATCH_MAX_DFA_STATE * dfa->classCount * sizeof(int32_t));
+    dfa->accept = corto_calloc(CORTO_IDMATCH_MAX_DFA_STATE);
+
+    for (i = 0; i < nfa.startCount; i ++) {
+        corto_idmatchNfa_closure(&nfa, sets, nfa.start[i]);
+    }
+    dfa->stateCount = 1;
+
+    set = corto_alloc(nfa.count);
+    for (s = 0; s < dfa->stateCount; s ++) {
+        uint8_t *cur = &sets[s * nfa.count];
+        dfa->accept[s] = cur[0]; /* State 0 is the MATCH state */
+
+        for (c = 0; c < dfa->classCount; c ++) {
+            bool empty = true;
+            memset(set, 0, nfa.count);
+            for (i = 0; i < nfa.count; i ++) {
+                if (cur[i] &&
+                    corto_idmatchNfa_accepts(&nfa.states[i], representative[c]))
+                {
+                    corto_idmatchNfa_closure(&nfa, set, nfa.states[i].out);
+                    empty = false;
+                }
+            }
+
+            if (empty) {
+                dfa->next[s * dfa->classCount + c] = -1;
+                continue;
+            }
+
+            for (cl = 0; cl < dfa->stateCount; cl ++) {
+                if (!memcmp(&sets[cl * nfa.count], set, nfa.count)) {
+                    break;
+                }
+            }
+            if (cl == dfa->stateCount) {
+                if (dfa->stateCount == CORTO_IDMATCH_MAX_DFA_STATE) {
+                    goto unsupported;
+                }
+                memcpy(&sets[cl * nfa.count], set, nfa.count);
+                dfa->stateCount ++;
+            }
+            dfa->next[s * dfa->classCount + c] = cl * dfa->classCount;
+        }
+    }
+
+    dfa->next = corto_realloc(
+        dfa->next, dfa->stateCount * dfa->classCount * sizeof(int32_t));
+    dfa->accept = corto_realloc(dfa->accept, dfa->stateCount);
+
+    /* A state is live if it accepts, or has a transition to a live state */
+    dfa->live = corto_alloc(dfa->stateCount);
+    memcpy(dfa->live, dfa->accept, dfa->stateCount);
+    do {
+        changed = false;
+        for (s = 0; s < dfa->stateCount; s ++) {
+            if (dfa->live[s]) {
+                continue;
+            }
+            for (c = 0; c < dfa->classCount; c ++) {
+                int32_t next = dfa->next[s * dfa->classCount + c];
+                if ((next >= 0) && dfa->live[next / dfa->classCount]) {
+                    dfa->live[s] = changed = true;
+                    break;
+                }
+            }
+        }
+    } while (changed);
+
+    corto_dealloc(set);
+    corto_dealloc(sets);
+    corto_dealloc(nfa.states);
+    corto_dealloc(nfa.start);
+    return dfa;
+unsupported:
+    corto_idmatch_dfaFree(dfa);
+    corto_dealloc(set);
+    corto_dealloc(sets);
+    corto_dealloc(nfa.states);
+    corto_dealloc(nfa.start);
+    return NULL;
+}
+
+static
+bool corto_idmatch_dfaRun(
+    corto_idmatch_dfa *dfa,
+    const char *id)
+{
+    const uint8_t *ptr = (const uint8_t*)corto_idmatch_skipRoot(id);
+    int32_t row = 0;
+    uint8_t ch;
+
+    if (!ptr) {
+        return false;
+    }
+
+    while ((ch = *ptr++)) {
+        row = dfa->next[row + dfa->classes[ch]];
+        if (row < 0) {
+            return false;
+        }
+    }
+
+    return dfa->accept[row / dfa->classCount];
+}
+
+/* -- Specialized programs --
+ * Programs with a common shape are matched without automaton or interpreter.
+ * The result is the same as that of the automaton: elements are compared
+ * insensitive of case, and an element that starts with a '.' does not match an
+ * identifier or filter. */
+
+const char* corto_idmatch_skipRoot(
+    const char *id)
+{
+    if (id[0] == '/') {
+        id ++;
+        if (id[0] == '/') {
+            id ++;
+        } else if (!id[0]) {
+            return NULL;
+        }
+    } else if (!id[0]) {
+        return NULL;
+    }
+    return id;
+}
+
+/* Test if str starts with lowercase literal of n characters. Literals are
+ * short, so a scalar loop is faster than a call to the SIMD kernels. The null
+ * character of str never equals a character of the literal. */
+static inline
+bool corto_idmatch_literalPrefix(
+    const char *literal,
+    const char *str,
+    uint32_t n)
+{
+    uint32_t i;
+    for (i = 0; i < n; i ++) {
+        if (corto_simd_lower(str[i]) != literal[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Test if str doesn't contain a '/' */
+static inline
+bool corto_idmatch_lastElem(
+    const char *str)
+{
+    char ch;
+    while ((ch = *str) && (ch != '/')) {
+        str ++;
+    }
+    return !ch;
+}
+
+/* Test if str equals lowercase literal, insensitive of case */
+static inline
+bool corto_idmatch_literalEquals(
+    const char *literal,
+    const char *str)
+{
+    char ch;
+    while ((ch = *literal) && (corto_simd_lower(*str) == ch)) {
+        literal ++;
+        str ++;
+    }
+    return !ch && !*str;
+}
+
+/* Test if alternative from op to end is a path of identifiers, optionally
+ * followed by a scope or tree operator and '*'. The operator is returned in
+ * last_out, which is NONE if the alternative only consists of the path. */
+static
+int16_t corto_idmatch_literalPath(
+    corto_idmatchOp *op,
+    corto_idmatchOp *end,
+    corto_idmatchToken *last_out)
+{
+    corto_idmatchOp *cur;
+
+    if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        op ++;
+    }
+
+    *last_out = CORTO_MATCHER_TOKEN_NONE;
+    if ((end - op > 2) &&
+        ((end[-2].token == CORTO_MATCHER_TOKEN_SCOPE) ||
+         (end[-2].token == CORTO_MATCHER_TOKEN_TREE)) &&
+        (end[-1].token == CORTO_MATCHER_TOKEN_FILTER) &&
+        !strcmp(end[-1].start, "*"))
+    {
+        *last_out = end[-2].token;
+        end -= 2;
+    }
+
+    if (end == op) {
+        return -1;
+    }
+
+    /* Identifiers must be separated by scope operators */
+    for (cur = op; cur < end; cur ++) {
+        corto_idmatchToken expect = ((cur - op) % 2)
+            ? CORTO_MATCHER_TOKEN_SCOPE
+            : CORTO_MATCHER_TOKEN_IDENTIFIER;
+        if (cur->token != expect) {
+            return -1;
+        }
+    }
+
+    return (end[-1].token == CORTO_MATCHER_TOKEN_IDENTIFIER) ? 0 : -1;
+}
+
+/* Join identifiers of program, separated by and ending with a '/' */
+static
+char* corto_idmatch_joinPath(
+    corto_idmatch_program program,
+    uint32_t *length_out)
+{
+    corto_buffer buf = CORTO_BUFFER_INIT;
+    uint32_t i;
+
+    for (i = 0; i < program->size; i ++) {
+        if (program->ops[i].token == CORTO_MATCHER_TOKEN_IDENTIFIER) {
+            corto_buffer_appendstr(&buf, program->ops[i].start);
+            corto_buffer_appendstrn(&buf, "/", 1);
+        }
+    }
+
+    char *result = corto_buffer_str(&buf);
+    *length_out = strlen(result);
+    return result;
+}
+
+/* Hash of element insensitive of case. The element ends at the first '/' or
+ * null character, which is returned in end_out. Setting bit 5 folds case of
+ * letters without a branch, other characters may collide which is resolved by
+ * comparing the identifiers. */
+static inline
+uint32_t corto_idmatch_elemHash(
+    const char *elem,
+    const char **end_out)
+{
+    uint32_t hash = 0;
+    char ch;
+
+    while ((ch = *elem) && (ch != '/')) {
+        hash = hash * 31 + ((uint8_t)ch | 0x20);
+        elem ++;
+    }
+
+    if (end_out) {
+        *end_out = elem;
+    }
+
+    return hash;
+}
+
+static
+corto_idmatch_idset* corto_idmatch_idsetCompile(
+    corto_idmatch_program program)
+{
+    uint32_t count = 0, size = 4, i;
+    corto_idmatch_idset *idset;
+
+    for (i = 0; i < program->size; i ++) {
+        if (program->ops[i].token == CORTO_MATCHER_TOKEN_IDENTIFIER) {
+            count ++;
+        }
+    }
+
+    /* Keep load factor below 50% */
+    while (size < count * 2) {
+        size *= 2;
+    }
+
+    idset = corto_calloc(sizeof(corto_idmatch_idset) +
+        size * sizeof(idset->slots[0]));
+    idset->size = size;
+
+    for (i = 0; i < program->size; i ++) {
+        const char *ident = program->ops[i].start;
+        if (program->ops[i].token != CORTO_MATCHER_TOKEN_IDENTIFIER) {
+            continue;
+        }
+
+        uint32_t hash = corto_idmatch_elemHash(ident, NULL);
+        uint32_t slot = hash & (size - 1);
+        while (idset->slots[slot].ident &&
+               strcmp(idset->slots[slot].ident, ident))
+        {
+            slot = (slot + 1) & (size - 1);
+        }
+        idset->slots[slot].hash = hash;
+        idset->slots[slot].ident = ident;
+        idset->first[(uint8_t)ident[0]] = true;
+        idset->first[(uint8_t)corto_simd_upper(ident[0])] = true;
+    }
+
+    return idset;
+}
+
+/* Find specialized kind for program. Only called for programs that don't
+ * match a single identifier, '.', '*' or '//'. */
+static
+void corto_idmatch_specialize(
+    corto_idmatch_program program)
+{
+    corto_idmatchOp *op, *end = program->ops;
+    corto_idmatchToken last;
+    bool identifiers = true;
+    uint32_t alternatives = 0;
+
+    /* List of identifiers, optionally preceded by a scope operator */
+    do {
+        op = end;
+        while ((end->token != CORTO_MATCHER_TOKEN_NONE) &&
+               (end->token != CORTO_MATCHER_TOKEN_SEPARATOR))
         {
-            data->ops[op].token = CORTO_MATCHER_TOKEN_FILTER;
-            data->ops[op].start = "*";
+            end ++;
+        }
+        if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
             op ++;
         }
-        data->size = op;
-        data->ops[op].token = CORTO_MATCHER_TOKEN_NONE; /* Close with NONE */
-        if (corto_idmatchValidate(data)) {
-            data->size = 0;
-            goto error;
+        if ((end - op != 1) || (op->token != CORTO_MATCHER_TOKEN_IDENTIFIER)) {
+            identifiers = false;
+        }
+        alternatives ++;
+    } while ((end ++)->token == CORTO_MATCHER_TOKEN_SEPARATOR);
+
+    if (identifiers) {
+        program->kind = 9;
+        program->idset = corto_idmatch_idsetCompile(program);
+        return;
+    }
+
+    if (alternatives != 1) {
+        return;
+    }
+
+    op = program->ops;
+    end = &program->ops[program->size];
+
+    /* Path of identifiers, optionally followed by a scope or tree operator */
+    if (!corto_idmatch_literalPath(op, end, &last)) {
+        program->literal = corto_idmatch_joinPath(
+            program, &program->literalLength);
+        if (last == CORTO_MATCHER_TOKEN_SCOPE) {
+            program->kind = 5;
+        } else if (last == CORTO_MATCHER_TOKEN_TREE) {
+            program->kind = 6;
+        } else {
+            /* Matched like an identifier, without the trailing '/' */
+            program->kind = 1;
+            program->literal[-- program->literalLength] = '\0';
+        }
+        return;
+    }
+
+    /* Filter with a single '*' at the start or end */
+    if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        op ++;
+    }
+    if ((end - op == 1) && (op->token == CORTO_MATCHER_TOKEN_FILTER)) {
+        const char *filter = op->start;
+        size_t length = strlen(filter);
+        size_t literalLength = strcspn(filter, "*?");
+
+        if ((literalLength == length - 1) && (filter[literalLength] == '*')) {
+            program->kind = 7;
+            program->literal = corto_strdup(filter);
+            program->literal[literalLength] = '\0';
+            program->literalLength = literalLength;
+        } else if ((length > 1) && (filter[0] == '*') &&
+                   (strcspn(&filter[1], "*?") == length - 1))
+        {
+            program->kind = 8;
+            program->literal = corto_strdup(&filter[1]);
+            program->literalLength = length - 1;
+        }
+    }
+}
+
+static
+bool corto_idmatch_runSpecialized(
+    corto_idmatch_program program,
+    const char *id)
+{
+    const char *ptr = corto_idmatch_skipRoot(id);
+    uint32_t length = program->literalLength;
+
+    if (!ptr) {
+        return false;
+    }
+
+    switch(program->kind) {
+    case 5:
+        /* Path followed by a single element */
+        if (!corto_idmatch_literalPrefix(program->literal, ptr, length)) {
+            return false;
+        }
+        ptr += length;
+        return (ptr[0] != '.') && corto_idmatch_lastElem(ptr);
+    case 6: {
+        /* Path followed by one or more elements */
+        if (!corto_idmatch_literalPrefix(program->literal, ptr, length)) {
+            return false;
+        }
+        const char *elem = strrchr(&ptr[length], '/');
+        return (elem ? elem[1] : ptr[length]) != '.';
+    }
+    case 7:
+        if (!corto_idmatch_literalPrefix(program->literal, ptr, length)) {
+            return false;
+        }
+        return corto_idmatch_lastElem(&ptr[length]);
+    case 8: {
+        const char *elemEnd = ptr;
+        while (*elemEnd && (*elemEnd != '/')) {
+            elemEnd ++;
+        }
+        if (*elemEnd || (ptr[0] == '.') || ((uint32_t)(elemEnd - ptr) < length)) {
+            return false;
         }
+        return corto_idmatch_literalPrefix(
+            program->literal, elemEnd - length, length);
     }
+    case 9: {
+        corto_idmatch_idset *idset = program->idset;
+        const char *ident, *elemEnd;
+        uint32_t hash, slot;
 
-    return 0;
-error:
-    return -1;
-}
+        /* Most ids are rejected on their first character */
+        if (!idset->first[(uint8_t)ptr[0]]) {
+            return false;
+        }
 
-corto_idmatch_program corto_idmatch_compile(
-    const char *expr,
-    bool allowScopes,
-    bool allowSeparators)
-{
-    corto_idmatch_program result = corto_alloc(sizeof(struct corto_idmatch_program_s));
-    result->kind = 0;
-    result->tokens = NULL;
+        hash = corto_idmatch_elemHash(ptr, &elemEnd);
 
-    corto_debug("match: compile expression '%s'", expr);
-    if (corto_idmatchParseIntern(result, expr, allowScopes, allowSeparators) || !result->size) {
-        if (!result->size) {
-            corto_throw("expression '%s' resulted in empty program", expr);
+        /* Ids with more than one element don't match */
+        if (*elemEnd) {
+            return false;
         }
-        corto_dealloc(result->tokens);
-        corto_dealloc(result);
-        result = NULL;
-        goto error;
+
+        slot = hash & (idset->size - 1);
+        while ((ident = idset->slots[slot].ident)) {
+            if ((idset->slots[slot].hash == hash) &&
+                corto_idmatch_literalEquals(ident, ptr))
+            {
+                return true;
+            }
+            slot = (slot + 1) & (idset->size - 1);
+        }
+        return false;
+    }
+    default:
+        return false;
     }
+}
 
+/* Select kind of program. Programs that can't be specialized keep kind 0, and
+ * are either interpreted or compiled to an automaton. */
+static
+void corto_idmatch_classify(
+    corto_idmatch_program result)
+{
     /* Optimize for common cases (*, simple identifier) */
     if (result->size == 1) {
         if (result->ops[0].token == CORTO_MATCHER_TOKEN_IDENTIFIER) {
@@ -384,8 +1304,330 @@ corto_idmatch_program corto_idmatch_compile(
         }
     }
 
+    if (!result->kind) {
+        corto_idmatch_specialize(result);
+    }
+}
+
+corto_idmatch_program corto_idmatch_compileFlags(
+    const char *expr,
+    uint32_t flags)
+{
+    corto_idmatch_program result;
+
+    corto_debug("match: compile expression '%s'", expr);
+    result = corto_idmatchParseIntern(
+        expr,
+        flags & CORTO_IDMATCH_ALLOW_SCOPES,
+        flags & CORTO_IDMATCH_ALLOW_SEPARATORS);
+    if (!result || !result->size) {
+        corto_throw("expression '%s' resulted in empty program", expr);
+        corto_dealloc(result);
+        result = NULL;
+        goto error;
+    }
+
+    corto_idmatch_classify(result);
+
+    /* Compile remaining programs to automaton */
+    if (!result->kind && !(flags & CORTO_IDMATCH_NO_DFA)) {
+        result->dfa = corto_idmatch_dfaCompile(result);
+    }
+
+    return result;
+error:
+    return NULL;
+}
+
+corto_idmatch_program corto_idmatch_compile(
+    const char *expr,
+    bool allowScopes,
+    bool allowSeparators)
+{
+    return corto_idmatch_compileFlags(expr,
+        (allowScopes ? CORTO_IDMATCH_ALLOW_SCOPES : 0) |
+        (allowSeparators ? CORTO_IDMATCH_ALLOW_SEPARATORS : 0));
+}
+
+/* -- Serialization --
+ * Programs are saved as a position independent image, so that a program can be
+ * compiled once, and loaded from a buffer or a mapped file by other processes.
+ * Pointers to tokens are stored as offsets. Numbers are stored in native byte
+ * order, images with another byte order are rejected by the magic number.
+ * Fields are copied with memcpy, so an image doesn't have to be aligned.
+ *
+ * An image contains, in this order:
+ * - the header
+ * - size ops
+ * - tokensLength bytes of tokens, padded to a multiple of 4 bytes
+ * - if the program has an automaton: 256 classes, stateCount * classCount
+ *   transitions, stateCount accept flags and stateCount live flags
+ *
+ * The kind of a loaded program is derived from its ops, which is cheap. Loading
+ * an automaton skips the subset construction, which is the expensive part of
+ * compiling a program. */
+
+#define CORTO_IDMATCH_IMAGE_MAGIC (0x4d444943) /* "CIDM" */
+#define CORTO_IDMATCH_IMAGE_VERSION (1)
+#define CORTO_IDMATCH_IMAGE_DFA (0x1)           /* Image contains automaton */
+#define CORTO_IDMATCH_IMAGE_STAR (0xffffffff)   /* Offset of "*" literal */
+#define CORTO_IDMATCH_IMAGE_PAD(length) (((length) + 3) & ~(size_t)3)
+
+typedef struct corto_idmatch_imageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t size;         /* Number of ops */
+    uint32_t tokensLength; /* Including the closing null character */
+    uint32_t classCount;   /* 0 if image has no automaton */
+    uint32_t stateCount;
+    uint32_t reserved;
+} corto_idmatch_imageHeader;
+
+typedef struct corto_idmatch_imageOp {
+    uint8_t token;
+    uint8_t containsWildcard;
+    uint16_t reserved;
+    uint32_t start;        /* Offset in tokens, or CORTO_IDMATCH_IMAGE_STAR */
+} corto_idmatch_imageOp;
+
+static
+size_t corto_idmatch_imageSize(
+    corto_idmatch_imageHeader *hdr)
+{
+    size_t result = sizeof(corto_idmatch_imageHeader) +
+        (size_t)hdr->size * sizeof(corto_idmatch_imageOp) +
+        CORTO_IDMATCH_IMAGE_PAD((size_t)hdr->tokensLength);
+
+    if (hdr->flags & CORTO_IDMATCH_IMAGE_DFA) {
+        result += 256 +
+            (size_t)hdr->stateCount * hdr->classCount * sizeof(int32_t) +
+            (size_t)hdr->stateCount * 2;
+    }
+
+    return result;
+}
+
+size_t corto_idmatch_save(
+    corto_idmatch_program program,
+    void *buffer,
+    size_t size)
+{
+    corto_idmatch_imageHeader hdr = {0};
+    corto_idmatch_dfa *dfa = program->dfa;
+    uint8_t *ptr = buffer;
+    size_t result;
+    uint32_t i;
+
+    hdr.magic = CORTO_IDMATCH_IMAGE_MAGIC;
+    hdr.version = CORTO_IDMATCH_IMAGE_VERSION;
+    hdr.size = program->size;
+    hdr.tokensLength = program->tokensLength;
+    if (dfa) {
+        hdr.flags = CORTO_IDMATCH_IMAGE_DFA;
+        hdr.classCount = dfa->classCount;
+        hdr.stateCount = dfa->stateCount;
+    }
+
+    result = corto_idmatch_imageSize(&hdr);
+    if (!buffer || (size < result)) {
+        return result;
+    }
+
+    memset(buffer, 0, result);
+    memcpy(ptr, &hdr, sizeof(hdr));
+    ptr += sizeof(hdr);
+
+    for (i = 0; i < program->size; i ++) {
+        corto_idmatchOp *op = &program->ops[i];
+        corto_idmatch_imageOp imageOp = {0};
+        imageOp.token = op->token;
+        imageOp.containsWildcard = op->containsWildcard;
+        if ((op->start >= program->tokens) &&
+            (op->start < &program->tokens[program->tokensLength]))
+        {
+            imageOp.start = op->start - program->tokens;
+        } else {
+            imageOp.start = CORTO_IDMATCH_IMAGE_STAR;
+        }
+        memcpy(ptr, &imageOp, sizeof(imageOp));
+        ptr += sizeof(imageOp);
+    }
+
+    memcpy(ptr, program->tokens, program->tokensLength);
+    ptr += CORTO_IDMATCH_IMAGE_PAD((size_t)program->tokensLength);
+
+    if (dfa) {
+        size_t transitions = (size_t)dfa->stateCount * dfa->classCount;
+        memcpy(ptr, dfa->classes, 256);
+        ptr += 256;
+        memcpy(ptr, dfa->next, transitions * sizeof(int32_t));
+        ptr += transitions * sizeof(int32_t);
+        memcpy(ptr, dfa->accept, dfa->stateCount);
+        ptr += dfa->stateCount;
+        memcpy(ptr, dfa->live, dfa->stateCount);
+    }
+
+    return result;
+}
+
+/* Load automaton from image, and check that it can't index outside of its
+ * tables when running */
+static
+corto_idmatch_dfa* corto_idmatch_dfaLoad(
+    corto_idmatch_imageHeader *hdr,
+    const uint8_t *ptr)
+{
+    corto_idmatch_dfa *dfa = corto_calloc(sizeof(corto_idmatch_dfa));
+    size_t transitions = (size_t)hdr->stateCount * hdr->classCount, i;
+
+    dfa->classCount = hdr->classCount;
+    dfa->stateCount = hdr->stateCount;
+    dfa->next = corto_alloc(transitions * sizeof(int32_t));
+    dfa->accept = corto_alloc(hdr->stateCount);
+    dfa->live = corto_alloc(hdr->stateCount);
+
+    memcpy(dfa->classes, ptr, 256);
+    ptr += 256;
+    memcpy(dfa->next, ptr, transitions * sizeof(int32_t));
+    ptr += transitions * sizeof(int32_t);
+    memcpy(dfa->accept, ptr, hdr->stateCount);
+    ptr += hdr->stateCount;
+    memcpy(dfa->live, ptr, hdr->stateCount);
+
+    for (i = 0; i < 256; i ++) {
+        if (dfa->classes[i] >= dfa->classCount) {
+            corto_throw("invalid class for character %d in automaton", i);
+            goto error;
+        }
+    }
+
+    for (i = 0; i < transitions; i ++) {
+        int32_t next = dfa->next[i];
+        if ((next != -1) &&
+            ((next < 0) || ((size_t)next >= transitions) ||
+             (next % dfa->classCount)))
+        {
+            corto_throw("invalid transition %d in automaton", next);
+            goto error;
+        }
+    }
+
+    for (i = 0; i < dfa->stateCount; i ++) {
+        if ((dfa->accept[i] > 1) || (dfa->live[i] > 1)) {
+            corto_throw("invalid flags for state %d in automaton", i);
+            goto error;
+        }
+    }
+
+    return dfa;
+error:
+    corto_idmatch_dfaFree(dfa);
+    return NULL;
+}
+
+corto_idmatch_program corto_idmatch_load(
+    const void *buffer,
+    size_t size)
+{
+    corto_idmatch_imageHeader hdr;
+    corto_idmatch_program result = NULL;
+    corto_idmatchOp *ops = NULL;
+    const uint8_t *ptr = buffer;
+    const char *tokens;
+    uint32_t i;
+
+    if (!buffer || (size < sizeof(hdr))) {
+        corto_throw("image is too small to contain an idmatch program");
+        goto error;
+    }
+
+    memcpy(&hdr, ptr, sizeof(hdr));
+    ptr += sizeof(hdr);
+
+    if (hdr.magic != CORTO_IDMATCH_IMAGE_MAGIC) {
+        corto_throw("image does not contain an idmatch program");
+        goto error;
+    }
+    if (hdr.version != CORTO_IDMATCH_IMAGE_VERSION) {
+        corto_throw("unsupported idmatch image version %u", hdr.version);
+        goto error;
+    }
+    if ((hdr.flags & ~CORTO_IDMATCH_IMAGE_DFA) || !hdr.size ||
+        !hdr.tokensLength || (hdr.size > size) || (hdr.tokensLength > size))
+    {
+        corto_throw("invalid idmatch image header");
+        goto error;
+    }
+    if (hdr.flags & CORTO_IDMATCH_IMAGE_DFA) {
+        if (!hdr.classCount || (hdr.classCount > 256) || !hdr.stateCount ||
+            (hdr.stateCount > CORTO_IDMATCH_MAX_DFA_STATE))
+        {
+            corto_throw("invalid automaton in idmatch image");
+            goto error;
+        }
+    }
+    if (corto_idmatch_imageSize(&hdr) > size) {
+        corto_throw("idmatch image is truncated");
+        goto error;
+    }
+
+    tokens = (const char*)ptr + hdr.size * sizeof(corto_idmatch_imageOp);
+    if (tokens[hdr.tokensLength - 1]) {
+        corto_throw("tokens in idmatch image are not terminated");
+        goto error;
+    }
+
+    ops = corto_alloc(hdr.size * sizeof(corto_idmatchOp));
+    for (i = 0; i < hdr.size; i ++) {
+        corto_idmatch_imageOp imageOp;
+        memcpy(&imageOp, ptr, sizeof(imageOp));
+        ptr += sizeof(imageOp);
+
+        if ((imageOp.token <= CORTO_MATCHER_TOKEN_NONE) ||
+            (imageOp.token > CORTO_MATCHER_TOKEN_SEPARATOR))
+        {
+            corto_throw("invalid token %d in idmatch image", imageOp.token);
+            goto error;
+        }
+        ops[i].token = imageOp.token;
+        ops[i].containsWildcard = imageOp.containsWildcard != 0;
+        if (imageOp.start == CORTO_IDMATCH_IMAGE_STAR) {
+            ops[i].start = "*";
+        } else if (imageOp.start < hdr.tokensLength) {
+            ops[i].start = (char*)&tokens[imageOp.start];
+        } else {
+            corto_throw("invalid token offset %u in idmatch image",
+                imageOp.start);
+            goto error;
+        }
+    }
+
+    if (corto_idmatchValidate(ops, hdr.size)) {
+        goto error;
+    }
+
+    result = corto_idmatch_programNew(
+        ops, hdr.size, tokens, hdr.tokensLength - 1);
+    corto_idmatch_classify(result);
+
+    if (hdr.flags & CORTO_IDMATCH_IMAGE_DFA) {
+        if (result->kind) {
+            corto_throw("unexpected automaton for specialized program");
+            goto error;
+        }
+        ptr = (const uint8_t*)tokens +
+            CORTO_IDMATCH_IMAGE_PAD((size_t)hdr.tokensLength);
+        if (!(result->dfa = corto_idmatch_dfaLoad(&hdr, ptr))) {
+            goto error;
+        }
+    }
+
+    corto_dealloc(ops);
     return result;
 error:
+    corto_dealloc(ops);
+    corto_idmatch_free(result);
     return NULL;
 }
 
@@ -403,7 +1645,7 @@ int corto_idmatch_scope(
     } else if (program->kind == 4) {
         result = 2;
     } else {
-        int i;
+        uint32_t i;
         for (i = 0; i < program->size; i++) {
             switch(program->ops[i].token) {
             case CORTO_MATCHER_TOKEN_SCOPE:
@@ -421,9 +1663,127 @@ int corto_idmatch_scope(
     return result;
 }
 
+/* Test if literal path starts with the first length characters of path,
+ * followed by a '/' */
+static
+bool corto_idmatch_literalUnder(
+    const char *literal,
+    const char *path,
+    size_t length)
+{
+    return (corto_simd_strimismatch(literal, path, length) == length) &&
+        (literal[length] == '/');
+}
+
+bool corto_idmatch_canMatchUnder(
+    corto_idmatch_program program,
+    const char *prefix)
+{
+    const char *path = prefix ? corto_idmatch_skipRoot(prefix) : NULL;
+    size_t length = path ? strlen(path) : 0;
+
+    if (!program->size) {
+        return false;
+    }
+
+    /* Ignore trailing '/' */
+    while (length && (path[length - 1] == '/')) {
+        length --;
+    }
+
+    /* Every program that can match an id can match an id under the root */
+    if (!length) {
+        if (program->dfa) {
+            return program->dfa->live[0];
+        }
+        return true;
+    }
+
+    switch(program->kind) {
+    case 0:
+        if (program->dfa) {
+            corto_idmatch_dfa *dfa = program->dfa;
+            int32_t row = 0;
+            size_t i;
+
+            /* Run the automaton for the prefix and the '/' that follows it */
+            for (i = 0; i <= length; i ++) {
+                uint8_t ch = (i < length) ? path[i] : '/';
+                row = dfa->next[row + dfa->classes[ch]];
+                if (row < 0) {
+                    return false;
+                }
+            }
+
+            return dfa->live[row / dfa->classCount];
+        }
+
+        /* Can't tell for interpreted programs */
+        return true;
+    case 1:
+        /* A single identifier only matches ids in the root */
+        return program->literal &&
+            corto_idmatch_literalUnder(program->literal, path, length);
+    case 5:
+        /* Literal includes the trailing '/' */
+        return corto_idmatch_literalUnder(program->literal, path, length);
+    case 6: {
+        /* Ids under the prefix match if either path is a prefix of the other */
+        uint32_t literalLength = program->literalLength;
+        if (literalLength <= length) {
+            return corto_simd_strimismatch(
+                program->literal, path, literalLength) == literalLength;
+        }
+        return corto_idmatch_literalUnder(program->literal, path, length);
+    }
+    case 4:
+        return true;
+    default:
+        /* '.', '*', prefix, suffix and identifier lists only match ids with a
+         * single element */
+        return false;
+    }
+}
+
+/* Current element of the id that is being matched. Elements are read directly
+ * from the id, which is not copied or modified. ptr is NULL when the cursor has
+ * moved past the last element. */
+typedef struct corto_idmatchCursor {
+    const char *ptr;
+    size_t len;
+} corto_idmatchCursor;
+
+static
+void corto_idmatchCursor_set(
+    corto_idmatchCursor *cursor,
+    const char *ptr)
+{
+    const char *end = strchr(ptr, '/');
+    cursor->ptr = ptr;
+    cursor->len = end ? (size_t)(end - ptr) : strlen(ptr);
+}
+
+static
+void corto_idmatchCursor_next(
+    corto_idmatchCursor *cursor)
+{
+    if (cursor->ptr) {
+        if (cursor->ptr[cursor->len] == '/') {
+            corto_idmatchCursor_set(cursor, &cursor->ptr[cursor->len + 1]);
+        } else {
+            cursor->ptr = NULL;
+        }
+    }
+}
+
+/* Test if cursor points to the last element */
+#define corto_idmatchCursor_isLast(cursor) \
+    ((cursor).ptr && ((cursor).ptr[(cursor).len] != '/'))
+
+static
 bool corto_idmatch_runExpr(
     corto_idmatchOp **op,
-    const char **elements[],
+    corto_idmatchCursor *elem,
     corto_idmatchToken precedence)
 {
     bool done = FALSE;
@@ -431,92 +1791,106 @@ bool corto_idmatch_runExpr(
     bool right = FALSE;
     bool identifierMatched = FALSE;
     corto_idmatchOp *cur;
-    const char **start = *elements; // Pointer to array of strings
+    corto_idmatchCursor start = *elem;
 
     do {
-        /*printf("eval %s [%s => %s] (prec=%s)\n",
-          corto_idmatchTokenStr((*op)->token),
-          (*elements)[0],
-          (*op)->start,
-          corto_idmatchTokenStr(precedence));*/
-
-        cur = *op; (*op) ++;
+        cur = *op;
+        if (cur->token == CORTO_MATCHER_TOKEN_NONE) {
+            /* Operator expected an operand, don't move past end of program */
+            result = FALSE;
+            break;
+        }
+        (*op) ++;
 
         switch(cur->token) {
         case CORTO_MATCHER_TOKEN_THIS:
-            result = !strcmp(".", (*elements)[0]);
+            result = elem->ptr && (elem->len == 1) && (elem->ptr[0] == '.');
             identifierMatched = TRUE;
             break;
         case CORTO_MATCHER_TOKEN_IDENTIFIER:
-        case CORTO_MATCHER_TOKEN_FILTER: {
-            const char *elem = (*elements)[0];
-            if (elem && (elem[0] != '.')) {
-                result = !fnmatch(cur->start, (*elements)[0], 0);
+        case CORTO_MATCHER_TOKEN_FILTER:
+            if (elem->ptr && (elem->ptr[0] != '.')) {
+                result = corto_idmatch_glob(
+                    cur->start, CORTO_STRVIEW(elem->ptr, elem->len));
             } else {
                 result = FALSE;
                 done = TRUE;
             }
             identifierMatched = TRUE;
             break;
-        }
         case CORTO_MATCHER_TOKEN_AND:
-            right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_IDENTIFIER);
+            right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_IDENTIFIER);
             if (result) result = right;
             break;
         case CORTO_MATCHER_TOKEN_OR:
-            right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_AND);
+            right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_AND);
             if (!result) result = right;
             break;
         case CORTO_MATCHER_TOKEN_NOT:
-            right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_OR);
+            right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_OR);
             if (result) result = !right;
             break;
         case CORTO_MATCHER_TOKEN_SCOPE:
-            (*elements)++;
-            if (!(*elements)[0]) {
+            corto_idmatchCursor_next(elem);
+            if (!elem->ptr) {
                 result = FALSE;
                 done = TRUE;
-                (*op)++; /* progress op for skipped value */
+                /* progress op for skipped value */
+                if ((*op)->token != CORTO_MATCHER_TOKEN_NONE) {
+                    (*op)++;
+                }
             } else {
-                right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_NOT);
+                right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_NOT);
                 if (result) result = right;
             }
             break;
         case CORTO_MATCHER_TOKEN_TREE: {
-            corto_idmatchOp *opPtr = *op;
+            corto_idmatchOp *opPtr = *op, *segmentEnd = opPtr;
             if (identifierMatched) {
                 if (!result) {
                     done = TRUE;
                     break;
                 }
-                (*elements)++;
+                corto_idmatchCursor_next(elem);
+            }
 
+            /* The segment after the tree operator runs until the next tree
+             * operator or the end of the alternative. */
+            while ((segmentEnd->token != CORTO_MATCHER_TOKEN_NONE) &&
+                   (segmentEnd->token != CORTO_MATCHER_TOKEN_TREE) &&
+                   (segmentEnd->token != CORTO_MATCHER_TOKEN_SEPARATOR))
+            {
+                segmentEnd ++;
             }
+            bool lastSegment = segmentEnd->token != CORTO_MATCHER_TOKEN_TREE;
 
-            const char **elementPtr = *elements, **elementFound = NULL;
+            corto_idmatchCursor elemPtr = *elem, elemFound = {NULL, 0};
             right = FALSE;
-            if (!elementPtr[0]) {
-                result = TRUE;
-                done = TRUE;
-                (*op)++; /* progress op for skipped value */
-            } else {
-                do {
-                    *elements = elementPtr;
-                    *op = opPtr;
-                    right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_SCOPE);
-                    if (right) {
-                        elementFound = *elements;
-                    }
-                } while ((elementFound ? right : !right) && (++elementPtr)[0]);
-                if ((result = (elementFound != NULL))) {
-                    *elements = elementFound;
+            /* Find the first position where the segment matches. The last
+             * segment must end at the last element of the id. */
+            for (; elemPtr.ptr; corto_idmatchCursor_next(&elemPtr)) {
+                *elem = elemPtr;
+                *op = opPtr;
+                right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_SCOPE);
+                if (right && (!lastSegment || corto_idmatchCursor_isLast(*elem))) {
+                    elemFound = *elem;
+                    break;
                 }
             }
+
+            *op = segmentEnd;
+            if ((result = (elemFound.ptr != NULL))) {
+                /* A next tree operator continues after the matched segment */
+                *elem = elemFound;
+                identifierMatched = TRUE;
+            } else {
+                done = TRUE;
+            }
             break;
         }
         case CORTO_MATCHER_TOKEN_SEPARATOR:
-            *(elements) = start;
-            right = corto_idmatch_runExpr(op, elements, CORTO_MATCHER_TOKEN_TREE);
+            *elem = start;
+            right = corto_idmatch_runExpr(op, elem, CORTO_MATCHER_TOKEN_TREE);
             if (!result) {
                 result = right;
             }
@@ -533,46 +1907,75 @@ bool corto_idmatch_runExpr(
     return result;
 }
 
-bool corto_idmatch_run(
+static
+bool corto_idmatch_runInterpreter(
     corto_idmatch_program program,
     const char *str)
 {
-    bool result = FALSE;
+    corto_idmatchOp *op = program->ops;
+    corto_idmatchCursor elem;
 
-    if (!program->size) {
+    /* Ignore leading scope token ('/') in string */
+    if (!(str = corto_idmatch_skipRoot(str))) {
         return FALSE;
     }
+    corto_idmatchCursor_set(&elem, str);
 
-    if (program->kind == 0) {
-        const char *elements[CORTO_MAX_SCOPE_DEPTH + 1];
-        corto_idmatchOp *op = program->ops;
-        const char **elem = elements;
-        corto_id id;
-        strcpy(id, str);
-        strlower(id);
-
-        int8_t elementCount = corto_pathToArray(id, elements, "/");
-        if (elementCount == -1) {
-            goto error;
+    /* Evaluate alternatives separately. Each alternative must match all
+     * elements of the id. */
+    do {
+        corto_idmatchOp *altOp = op;
+        corto_idmatchCursor altElem = elem;
+
+        /* Ignore leading scope token ('/') in expression */
+        if (altOp->token == CORTO_MATCHER_TOKEN_SCOPE) {
+            altOp ++;
         }
-        elements[elementCount] = NULL;
 
-        /* Ignore leading scope tokens ('/') in expression and string */
-        if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        if (corto_idmatch_runExpr(&altOp, &altElem, CORTO_MATCHER_TOKEN_TREE) &&
+            corto_idmatchCursor_isLast(altElem))
+        {
+            return TRUE;
+        }
+
+        while ((op->token != CORTO_MATCHER_TOKEN_NONE) &&
+               (op->token != CORTO_MATCHER_TOKEN_SEPARATOR))
+        {
             op ++;
         }
-        if (!elements[0][0]) elem++;
+    } while ((op ++)->token == CORTO_MATCHER_TOKEN_SEPARATOR);
 
-        result = corto_idmatch_runExpr(&op, &elem, CORTO_MATCHER_TOKEN_SEPARATOR);
-        if (result) {
-            if (elem != &elements[elementCount - 1]) {
-                /* Not all elements have been matched */
-                result = FALSE;
-            }
+    return FALSE;
+}
+
+bool corto_idmatch_run(
+    corto_idmatch_program program,
+    const char *str)
+{
+    bool result = FALSE;
+
+    if (!program->size) {
+        return FALSE;
+    }
+
+    if (program->kind == 0) {
+        if (program->dfa) {
+            result = corto_idmatch_dfaRun(program->dfa, str);
+#ifdef CORTO_IDMATCH_VERIFY
+            corto_assert(result == corto_idmatch_runInterpreter(program, str),
+                "automaton and interpreter disagree on '%s'", str);
+#endif
+        } else {
+            result = corto_idmatch_runInterpreter(program, str);
         }
     } else if (program->kind == 1) {
-        /* Match identifier */
-        result = !stricmp(program->ops[0].start, str);
+        /* Match identifier, which is the last op if preceded by a scope. For
+         * paths of identifiers the literal contains the path. */
+        const char *ptr = corto_idmatch_skipRoot(str);
+        const char *ident = program->literal
+            ? program->literal
+            : program->ops[program->size - 1].start;
+        result = ptr && corto_idmatch_literalEquals(ident, ptr);
     } else if (program->kind == 2) {
         result = !strcmp(".", str);
     } else if (program->kind == 3) {
@@ -591,11 +1994,11 @@ bool corto_idmatch_run(
         if (strcmp(str, ".")) {
             result = TRUE;
         }
+    } else {
+        result = corto_idmatch_runSpecialized(program, str);
     }
 
     return result;
-error:
-    return FALSE;
 }
 
 const char* corto_matchParent(
@@ -603,7 +2006,7 @@ const char* corto_matchParent(
     const char *expr)
 {
     const char *parentPtr = parent, *exprPtr = expr;
-    char parentCh, exprCh;
+    size_t i;
 
     if (!parent) {
         return expr;
@@ -616,19 +2019,10 @@ const char* corto_matchParent(
         return exprPtr;
     }
 
-    while ((parentCh = *parentPtr) &&
-           (exprCh = *exprPtr))
-    {
-        if (parentCh < 97) parentCh = tolower(parentCh);
-        if (exprCh < 97) exprCh = tolower(exprCh);
-
-        if (parentCh != exprCh) {
-            break;
-        }
-
-        parentPtr++;
-        exprPtr++;
-    }
+    /* Skip common prefix, insensitive of case */
+    i = corto_simd_strimismatch(parentPtr, exprPtr, SIZE_MAX);
+    parentPtr += i;
+    exprPtr += i;
 
     if (*parentPtr == '\0') {
         if (*exprPtr == '/') {
@@ -646,33 +2040,18 @@ const char* corto_matchParent(
 
 void corto_idmatch_free(corto_idmatch_program matcher) {
     if (matcher) {
-        if (matcher->tokens) {
-            corto_dealloc(matcher->tokens);
-        }
+        corto_idmatch_dfaFree(matcher->dfa);
+        corto_dealloc(matcher->literal);
+        corto_dealloc(matcher->idset);
         corto_dealloc(matcher);
     }
 }
 
-bool corto_idmatch(
-    const char *expr,
-    const char *str)
-{
-    struct corto_idmatch_program_s matcher;
-    if (corto_idmatchParseIntern(&matcher, expr, TRUE, TRUE)) {
-        goto error;
-    }
-    bool result = corto_idmatch_run(&matcher, str);
-    corto_dealloc(matcher.tokens);
-    return result;
-error:
-    return FALSE;
-}
-
 int corto_idmatch_get_scope(
     corto_idmatch_program program)
 {
     int result = 1;
-    int32_t op;
+    uint32_t op;
     bool quit = false;
 
     for (op = 0; (op < program->size) && !quit; op ++) {
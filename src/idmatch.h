@@ -44,15 +44,62 @@ typedef struct corto_idmatchOp {
     bool containsWildcard;
 } corto_idmatchOp;
 
+/* Maximum number of states in an automaton before falling back to interpreter */
+#define CORTO_IDMATCH_MAX_DFA_STATE (256)
+
+/* Deterministic automaton over the bytes of an id. Bytes are mapped to classes
+ * of bytes that behave the same in every state, which keeps the transition
+ * table small. Uppercase letters map to the class of their lowercase letter. */
+typedef struct corto_idmatch_dfa {
+    uint8_t classes[256];
+    uint16_t classCount;
+    uint16_t stateCount;
+    int32_t *next;   /* Transitions, stored as offset of the row of the next
+                      * state (state * classCount). -1 if id doesn't match. */
+    uint8_t *accept; /* stateCount flags, set if state matches the id */
+    uint8_t *live;   /* stateCount flags, set if an accepting state can be
+                      * reached from state */
+} corto_idmatch_dfa;
+
+/* Hash set with the identifiers of a list of identifiers (a,b,c) */
+typedef struct corto_idmatch_idset {
+    bool first[256]; /* Set for first characters of identifiers */
+    uint32_t size;   /* Always a power of two */
+    struct {
+        uint32_t hash;
+        const char *ident; /* Points to tokens of program, NULL if empty */
+    } slots[];
+} corto_idmatch_idset;
+
 struct corto_idmatch_program_s {
-    int kind; /* 0 = default, 1 = identifier, 2 = this, 3 = /, 4 = // */
-    corto_idmatchOp ops[CORTO_MATCHER_MAX_OP];
-    uint8_t size;
-    char *tokens;
+    int kind; /* 0 = default, 1 = identifier or path, 2 = this, 3 = /, 4 = //,
+               * 5 = scope of literal path (a/b/), 6 = tree of literal path
+               * (a/b//), 7 = prefix (ab*), 8 = suffix (*ab), 9 = a,b,c */
+    uint32_t size;          /* Number of ops, excluding closing NONE */
+    char *tokens;           /* Stored after ops, in the same allocation */
+    uint32_t tokensLength;  /* Including the closing null character */
+    corto_idmatch_dfa *dfa; /* NULL if program is interpreted */
+    char *literal;          /* Path of kind 1, prefix or suffix of kind 5 - 8 */
+    uint32_t literalLength;
+    corto_idmatch_idset *idset; /* Identifiers of kind 9 */
+    corto_idmatchOp ops[];  /* size + 1 ops, closed by NONE */
 };
 
-int16_t corto_idmatchParseIntern(
-    corto_idmatch_program data,
+/* Skip leading '/' of id in the same way as corto_pathToArray: a second '/'
+ * is skipped as well. Returns NULL if the id has no elements ("" or "/"). */
+const char* corto_idmatch_skipRoot(
+    const char *id);
+
+/* Match element against a lowercase glob pattern with '*' and '?' wildcards,
+ * insensitive of case. Equivalent to fnmatch for patterns accepted by the
+ * parser, which can't contain '[' or backslashes. */
+bool corto_idmatch_glob(
+    const char *pattern,
+    corto_strview str);
+
+/* Parse expression into a program with an exactly sized array of ops. Returns
+ * NULL if the expression is invalid. */
+corto_idmatch_program corto_idmatchParseIntern(
     const char *expr,
     bool allowScopes,
     bool allowSeparators);
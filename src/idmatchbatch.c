@@ -0,0 +1,274 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "base.h"
+#include "idmatch.h"
+#include "simd.h"
+
+/* Batches match many ids against one program. Before the ids are evaluated by
+ * the interpreter, a literal is extracted from the program that every matching
+ * id must contain, like "sensor" in "a//sensor?&*1". Ids are scanned for a
+ * character of the literal with memchr, which rejects most non-candidates
+ * without running the interpreter. Automatons and specialized programs already
+ * evaluate an id in a single pass, and are run without prefilter.
+ *
+ * Large batches can be split over the workers of the shared thread pool. Every
+ * worker writes a range of whole words of the bitset, so workers never write to
+ * the same word. */
+
+/* Minimum number of ids that is assigned to a worker */
+#define CORTO_IDMATCH_BATCH_MIN_WORKER_IDS (4096)
+
+typedef struct corto_idmatch_prefilter {
+    const char *literal; /* Lowercase, not null terminated */
+    uint32_t length;     /* 0 if program has no prefilter */
+    uint32_t anchor;     /* Offset of character in literal to scan for */
+    char ch;             /* Character to scan for */
+    char chUpper;        /* Uppercase of ch, same as ch if not a letter */
+} corto_idmatch_prefilter;
+
+typedef struct corto_idmatch_batchJob {
+    corto_idmatch_program program;
+    corto_idmatch_prefilter *prefilter;
+    const char **ids;
+    uint32_t start;
+    uint32_t end;
+    uint64_t *bitset;
+    uint32_t matched;
+} corto_idmatch_batchJob;
+
+/* Find the longest literal in the program that matching ids must contain. This
+ * is only done for programs with a single alternative of identifiers, filters,
+ * scopes and '&', as every token of such a program must match an element of
+ * the id. */
+static
+void corto_idmatch_prefilterCompile(
+    corto_idmatch_program program,
+    corto_idmatch_prefilter *prefilter)
+{
+    uint32_t i;
+
+    prefilter->length = 0;
+
+    if (program->kind || program->dfa) {
+        return;
+    }
+
+    for (i = 0; i < program->size; i ++) {
+        corto_idmatchOp *op = &program->ops[i];
+
+        switch(op->token) {
+        case CORTO_MATCHER_TOKEN_IDENTIFIER:
+        case CORTO_MATCHER_TOKEN_FILTER: {
+            const char *ptr = op->start;
+            while (*ptr) {
+                uint32_t length = strcspn(ptr, "*?");
+                if (length > prefilter->length) {
+                    prefilter->literal = ptr;
+                    prefilter->length = length;
+                }
+                ptr += length;
+                if (*ptr) {
+                    ptr ++;
+                }
+            }
+            break;
+        }
+        case CORTO_MATCHER_TOKEN_SCOPE:
+        case CORTO_MATCHER_TOKEN_TREE:
+        case CORTO_MATCHER_TOKEN_AND:
+            break;
+        default:
+            prefilter->length = 0;
+            return;
+        }
+    }
+
+    if (prefilter->length) {
+        /* Prefer scanning for a character that isn't a letter, which only
+         * requires a single memchr. */
+        prefilter->anchor = 0;
+        for (i = 0; i < prefilter->length; i ++) {
+            if (!isalpha((unsigned char)prefilter->literal[i])) {
+                prefilter->anchor = i;
+                break;
+            }
+        }
+        prefilter->ch = prefilter->literal[prefilter->anchor];
+        prefilter->chUpper = corto_simd_upper(prefilter->ch);
+    }
+}
+
+/* Test if id contains the literal of the prefilter, insensitive of case */
+static
+bool corto_idmatch_prefilterRun(
+    corto_idmatch_prefilter *prefilter,
+    const char *id)
+{
+    const char *literal = prefilter->literal;
+    uint32_t length = prefilter->length, anchor = prefilter->anchor;
+    const char *ptr, *end, *found, *upper;
+    size_t idLength = strlen(id);
+
+    if (idLength < length) {
+        return false;
+    }
+
+    /* Positions of the anchor that leave room for the rest of the literal */
+    ptr = id + anchor;
+    end = id + idLength - (length - anchor - 1);
+
+    while (ptr < end) {
+        found = memchr(ptr, prefilter->ch, end - ptr);
+        if (prefilter->chUpper != prefilter->ch) {
+            upper = memchr(ptr, prefilter->chUpper, (found ? found : end) - ptr);
+            if (upper) {
+                found = upper;
+            }
+        }
+
+        if (!found) {
+            break;
+        }
+
+        if (corto_simd_strimismatch(literal, found - anchor, length) == length) {
+            return true;
+        }
+
+        ptr = found + 1;
+    }
+
+    return false;
+}
+
+static
+void corto_idmatch_batchRun(
+    void *arg)
+{
+    corto_idmatch_batchJob *job = arg;
+    corto_idmatch_program program = job->program;
+    corto_idmatch_prefilter *prefilter = job->prefilter;
+    uint32_t i, matched = 0;
+    uint64_t word = 0;
+
+    /* Start is always a multiple of 64, so words are written as a whole */
+    for (i = job->start; i < job->end; i ++) {
+        const char *id = job->ids[i];
+
+        if (!prefilter->length || corto_idmatch_prefilterRun(prefilter, id)) {
+            if (corto_idmatch_run(program, id)) {
+                word |= 1ull << (i % 64);
+                matched ++;
+            }
+        }
+
+        if ((i % 64) == 63) {
+            job->bitset[i / 64] = word;
+            word = 0;
+        }
+    }
+
+    if (i % 64) {
+        job->bitset[i / 64] = word;
+    }
+
+    job->matched = matched;
+}
+
+uint32_t corto_idmatch_runBatchParallel(
+    corto_idmatch_program program,
+    const char *ids[],
+    uint32_t count,
+    uint64_t *bitset_out,
+    uint32_t workers)
+{
+    corto_idmatch_prefilter prefilter;
+    uint32_t words = (count + 63) / 64, matched = 0, i;
+
+    if (!program->size) {
+        memset(bitset_out, 0, words * sizeof(uint64_t));
+        return 0;
+    }
+
+    corto_idmatch_prefilterCompile(program, &prefilter);
+
+    if (workers > count / CORTO_IDMATCH_BATCH_MIN_WORKER_IDS) {
+        workers = count / CORTO_IDMATCH_BATCH_MIN_WORKER_IDS;
+    }
+
+    if (workers <= 1) {
+        corto_idmatch_batchJob job = {
+            program, &prefilter, ids, 0, count, bitset_out, 0
+        };
+        corto_idmatch_batchRun(&job);
+        return job.matched;
+    }
+
+    corto_idmatch_batchJob *jobs =
+        corto_alloc(workers * sizeof(corto_idmatch_batchJob));
+    corto_pool pool = corto_pool_default();
+    corto_pool_group group = {0};
+    if (!pool) {
+        corto_catch();
+    }
+
+    /* Divide words of the bitset over workers, the calling thread runs the
+     * first job, and all jobs if there is no pool. */
+    for (i = 0; i < workers; i ++) {
+        uint32_t start = (uint64_t)words * i / workers * 64;
+        uint32_t end = (uint64_t)words * (i + 1) / workers * 64;
+        jobs[i] = (corto_idmatch_batchJob){
+            program, &prefilter, ids, start, end < count ? end : count,
+            bitset_out, 0
+        };
+        if (i && (!pool || corto_pool_submit(
+            pool, &group, corto_idmatch_batchRun, &jobs[i])))
+        {
+            if (pool) {
+                corto_catch();
+            }
+            corto_idmatch_batchRun(&jobs[i]);
+        }
+    }
+
+    corto_idmatch_batchRun(&jobs[0]);
+    if (pool) {
+        corto_pool_wait(pool, &group);
+    }
+
+    for (i = 0; i < workers; i ++) {
+        matched += jobs[i].matched;
+    }
+
+    corto_dealloc(jobs);
+
+    return matched;
+}
+
+uint32_t corto_idmatch_runBatch(
+    corto_idmatch_program program,
+    const char *ids[],
+    uint32_t count,
+    uint64_t *bitset_out)
+{
+    return corto_idmatch_runBatchParallel(program, ids, count, bitset_out, 1);
+}
@@ -0,0 +1,347 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "base.h"
+#include "idmatch.h"
+
+/* corto_idmatch keeps compiled programs in a cache, so that expressions that
+ * are matched repeatedly are only parsed once. The cache holds at most
+ * CORTO_IDMATCH_CACHE_SIZE programs, and evicts the least recently used
+ * program when it is full.
+ *
+ * Programs are first compiled without automaton, which is cheap. Once an
+ * expression has been used CORTO_IDMATCH_CACHE_PROMOTE times, it is compiled
+ * again with automaton, and the entry is replaced.
+ *
+ * Entries are reference counted. The cache holds one reference, and every call
+ * that is running the program holds one, so that entries can be evicted while
+ * in use by another thread. */
+
+#define CORTO_IDMATCH_CACHE_PROMOTE (8)
+#define CORTO_IDMATCH_CACHE_BUCKETS (CORTO_IDMATCH_CACHE_SIZE * 2)
+
+typedef struct corto_idmatch_cacheEntry corto_idmatch_cacheEntry;
+
+struct corto_idmatch_cacheEntry {
+    corto_idmatch_cacheEntry *next;  /* Next entry in bucket */
+    corto_idmatch_cacheEntry *newer; /* Entry that was used after this one */
+    corto_idmatch_cacheEntry *older; /* Entry that was used before this one */
+    corto_idmatch_program program;
+    uint32_t hash;
+    uint32_t uses;
+    int refcount;
+    bool interpreted;                /* Set if program can be promoted */
+    char expr[];
+};
+
+extern corto_mutex_s corto_idmatch_lock;
+
+static corto_idmatch_cacheEntry *corto_idmatch_cache_buckets[CORTO_IDMATCH_CACHE_BUCKETS];
+static corto_idmatch_cacheEntry *corto_idmatch_cache_newest;
+static corto_idmatch_cacheEntry *corto_idmatch_cache_oldest;
+static uint32_t corto_idmatch_cache_count;
+static uint64_t corto_idmatch_cache_hits;
+static uint64_t corto_idmatch_cache_misses;
+static uint64_t corto_idmatch_cache_evictions;
+
+static
+corto_idmatch_cacheEntry* corto_idmatch_cacheEntry_new(
+    const char *expr,
+    uint32_t hash,
+    bool automaton)
+{
+    corto_idmatch_program program = corto_idmatch_compileFlags(expr,
+        CORTO_IDMATCH_ALLOW_SCOPES |
+        CORTO_IDMATCH_ALLOW_SEPARATORS |
+        (automaton ? 0 : CORTO_IDMATCH_NO_DFA));
+    if (!program) {
+        goto error;
+    }
+
+    size_t length = strlen(expr);
+    corto_idmatch_cacheEntry *entry =
+        corto_alloc(sizeof(corto_idmatch_cacheEntry) + length + 1);
+    entry->next = NULL;
+    entry->newer = NULL;
+    entry->older = NULL;
+    entry->program = program;
+    entry->hash = hash;
+    entry->uses = 0;
+    entry->refcount = 1;
+    entry->interpreted = !automaton && !program->kind;
+    memcpy(entry->expr, expr, length + 1);
+
+    return entry;
+error:
+    return NULL;
+}
+
+static
+void corto_idmatch_cacheEntry_release(
+    corto_idmatch_cacheEntry *entry)
+{
+    if (!corto_adec(&entry->refcount)) {
+        corto_idmatch_free(entry->program);
+        corto_dealloc(entry);
+    }
+}
+
+/* Functions below must be called while holding corto_idmatch_lock */
+
+static
+corto_idmatch_cacheEntry* corto_idmatch_cache_lookup(
+    const char *expr,
+    uint32_t hash)
+{
+    corto_idmatch_cacheEntry *entry =
+        corto_idmatch_cache_buckets[hash % CORTO_IDMATCH_CACHE_BUCKETS];
+
+    while (entry && ((entry->hash != hash) || strcmp(entry->expr, expr))) {
+        entry = entry->next;
+    }
+
+    return entry;
+}
+
+static
+void corto_idmatch_cache_unlinkUse(
+    corto_idmatch_cacheEntry *entry)
+{
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        corto_idmatch_cache_newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        corto_idmatch_cache_oldest = entry->newer;
+    }
+    entry->newer = entry->older = NULL;
+}
+
+static
+void corto_idmatch_cache_linkUse(
+    corto_idmatch_cacheEntry *entry)
+{
+    entry->older = corto_idmatch_cache_newest;
+    entry->newer = NULL;
+    if (corto_idmatch_cache_newest) {
+        corto_idmatch_cache_newest->newer = entry;
+    } else {
+        corto_idmatch_cache_oldest = entry;
+    }
+    corto_idmatch_cache_newest = entry;
+}
+
+static
+void corto_idmatch_cache_remove(
+    corto_idmatch_cacheEntry *entry)
+{
+    corto_idmatch_cacheEntry **ptr =
+        &corto_idmatch_cache_buckets[entry->hash % CORTO_IDMATCH_CACHE_BUCKETS];
+
+    while (*ptr != entry) {
+        ptr = &(*ptr)->next;
+    }
+    *ptr = entry->next;
+
+    corto_idmatch_cache_unlinkUse(entry);
+    corto_idmatch_cache_count --;
+    corto_idmatch_cacheEntry_release(entry);
+}
+
+/* Add entry to cache. If the cache already has an entry for the expression,
+ * the new entry replaces it if it is the entry to replace. Otherwise the new
+ * entry is discarded. Returns the entry in the cache, with a reference for the
+ * caller. */
+static
+corto_idmatch_cacheEntry* corto_idmatch_cache_add(
+    corto_idmatch_cacheEntry *entry,
+    corto_idmatch_cacheEntry *replace)
+{
+    corto_idmatch_cacheEntry *existing =
+        corto_idmatch_cache_lookup(entry->expr, entry->hash);
+
+    if (existing) {
+        if (existing != replace) {
+            corto_ainc(&existing->refcount);
+            corto_idmatch_cacheEntry_release(entry);
+            return existing;
+        }
+        corto_idmatch_cache_remove(existing);
+    } else if (corto_idmatch_cache_count == CORTO_IDMATCH_CACHE_SIZE) {
+        corto_idmatch_cache_remove(corto_idmatch_cache_oldest);
+        corto_idmatch_cache_evictions ++;
+    }
+
+    uint32_t bucket = entry->hash % CORTO_IDMATCH_CACHE_BUCKETS;
+    entry->next = corto_idmatch_cache_buckets[bucket];
+    corto_idmatch_cache_buckets[bucket] = entry;
+    corto_idmatch_cache_linkUse(entry);
+    corto_idmatch_cache_count ++;
+
+    corto_ainc(&entry->refcount);
+    return entry;
+}
+
+/* Get entry for expression, with a reference for the caller */
+static
+corto_idmatch_cacheEntry* corto_idmatch_cache_get(
+    const char *expr)
+{
+    uint32_t hash = strhash(expr);
+    corto_idmatch_cacheEntry *entry = NULL, *added;
+    bool promote = false;
+
+    if (corto_mutex_lock(&corto_idmatch_lock)) {
+        goto error;
+    }
+    entry = corto_idmatch_cache_lookup(expr, hash);
+    if (entry) {
+        corto_idmatch_cache_hits ++;
+        corto_idmatch_cache_unlinkUse(entry);
+        corto_idmatch_cache_linkUse(entry);
+        corto_ainc(&entry->refcount);
+        promote = entry->interpreted &&
+            (++ entry->uses == CORTO_IDMATCH_CACHE_PROMOTE);
+    } else {
+        corto_idmatch_cache_misses ++;
+    }
+    corto_mutex_unlock(&corto_idmatch_lock);
+
+    /* Compile outside of the lock, so other threads aren't blocked */
+    if (!entry || promote) {
+        added = corto_idmatch_cacheEntry_new(expr, hash, promote);
+        if (!added) {
+            if (!entry) {
+                goto error;
+            }
+            corto_catch(); /* Keep using the interpreted program */
+            return entry;
+        }
+
+        if (corto_mutex_lock(&corto_idmatch_lock)) {
+            corto_idmatch_cacheEntry_release(added);
+            goto error;
+        }
+        added = corto_idmatch_cache_add(added, entry);
+        corto_mutex_unlock(&corto_idmatch_lock);
+
+        if (entry) {
+            corto_idmatch_cacheEntry_release(entry);
+        }
+        entry = added;
+    }
+
+    return entry;
+error:
+    if (entry) {
+        corto_idmatch_cacheEntry_release(entry);
+    }
+    return NULL;
+}
+
+bool corto_idmatch(
+    const char *expr,
+    const char *str)
+{
+    corto_idmatch_cacheEntry *entry = corto_idmatch_cache_get(expr);
+    if (!entry) {
+        goto error;
+    }
+
+    bool result = corto_idmatch_run(entry->program, str);
+    corto_idmatch_cacheEntry_release(entry);
+    return result;
+error:
+    return FALSE;
+}
+
+int16_t corto_idmatch_cache_prewarm(
+    const char *exprs[],
+    uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i ++) {
+        uint32_t hash = strhash(exprs[i]);
+        corto_idmatch_cacheEntry *entry =
+            corto_idmatch_cacheEntry_new(exprs[i], hash, true);
+        if (!entry) {
+            goto error;
+        }
+
+        if (corto_mutex_lock(&corto_idmatch_lock)) {
+            corto_idmatch_cacheEntry_release(entry);
+            goto error;
+        }
+
+        /* Replace existing entry, which may not have been promoted yet */
+        entry = corto_idmatch_cache_add(
+            entry, corto_idmatch_cache_lookup(exprs[i], hash));
+        corto_mutex_unlock(&corto_idmatch_lock);
+        corto_idmatch_cacheEntry_release(entry);
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+void corto_idmatch_cache_flush(void)
+{
+    if (corto_mutex_lock(&corto_idmatch_lock)) {
+        corto_throw(NULL);
+        return;
+    }
+
+    while (corto_idmatch_cache_oldest) {
+        corto_idmatch_cache_remove(corto_idmatch_cache_oldest);
+    }
+
+    corto_mutex_unlock(&corto_idmatch_lock);
+}
+
+void corto_idmatch_cache_stats(
+    corto_idmatch_cache_stats_t *stats_out)
+{
+    if (corto_mutex_lock(&corto_idmatch_lock)) {
+        corto_throw(NULL);
+        return;
+    }
+
+    stats_out->hits = corto_idmatch_cache_hits;
+    stats_out->misses = corto_idmatch_cache_misses;
+    stats_out->evictions = corto_idmatch_cache_evictions;
+    stats_out->count = corto_idmatch_cache_count;
+    stats_out->capacity = CORTO_IDMATCH_CACHE_SIZE;
+
+    corto_mutex_unlock(&corto_idmatch_lock);
+}
+
+void corto_idmatch_cache_deinit(void) {
+    corto_idmatch_cache_flush();
+    corto_idmatch_cache_hits = 0;
+    corto_idmatch_cache_misses = 0;
+    corto_idmatch_cache_evictions = 0;
+}
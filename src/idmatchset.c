@@ -0,0 +1,799 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "idmatch.h"
+
+/* A set merges patterns into a tree of scope elements. Each node of the tree
+ * represents the elements matched so far, and has children for identifiers
+ * (stored in a hash table shared by all nodes), children for filters, and a
+ * gap child for the tree operator. A gap node matches zero or more arbitrary
+ * elements, which is implemented by keeping it active for every element.
+ *
+ * Patterns that can be expressed by the automaton of corto_idmatch_compile
+ * are added to the tree, and follow the same rules:
+ * - elements that start with a '.' never match an identifier or filter
+ * - a tree operator matches zero or more arbitrary elements
+ * - a leading scope operator in an alternative is ignored
+ *
+ * Filters that start with a literal prefix, like 'sensor*', are stored in the
+ * hash table under their prefix, so that only filters with a matching prefix
+ * are evaluated. Each node keeps the lengths of the prefixes of its children.
+ *
+ * Programs that match '.', or any identifier in a scope or tree have their own
+ * fast paths in corto_idmatch_run, which the set replicates. Programs with
+ * other operators are matched one by one. */
+
+/* Parent of literals that match the whole id ('.' programs) */
+#define CORTO_IDMATCH_SET_ID (-2)
+
+/* Size of stack buffer for active nodes. Larger sets allocate from the heap. */
+#define CORTO_IDMATCH_SET_STACK (4096)
+
+typedef struct corto_idmatch_setNode {
+    int32_t gap;      /* Gap child, -1 if none */
+    int32_t globs;    /* First filter child without prefix, -1 if none */
+    int32_t sibling;  /* Next filter child with the same prefix, -1 if none */
+    int32_t prefixes; /* First prefix length of filter children, -1 if none */
+    int32_t accept;   /* First pattern that matches in this node, -1 if none */
+    uint32_t glob;    /* Offset of filter (without prefix) in strings */
+    bool isGap;
+    bool hasLiterals;
+} corto_idmatch_setNode;
+
+typedef struct corto_idmatch_setAccept {
+    uint32_t pattern;
+    int32_t next;
+} corto_idmatch_setAccept;
+
+typedef struct corto_idmatch_setPrefix {
+    uint32_t len;
+    int32_t next;
+} corto_idmatch_setPrefix;
+
+typedef struct corto_idmatch_setLiteral {
+    uint32_t hash;
+    int32_t parent;
+    int32_t node;     /* Child, or first filter if prefix. -1 if slot is empty */
+    bool prefix;      /* Set if entry is the prefix of filters */
+    uint32_t str;     /* Offset of literal in strings */
+    uint32_t len;
+} corto_idmatch_setLiteral;
+
+typedef struct corto_idmatch_setFallback {
+    uint32_t pattern;
+    corto_idmatch_program program;
+} corto_idmatch_setFallback;
+
+struct corto_idmatch_set_s {
+    uint32_t count;
+
+    corto_idmatch_setNode *nodes;
+    int32_t nodeCount;
+    int32_t nodeSize;
+
+    corto_idmatch_setAccept *accept;
+    int32_t acceptCount;
+    int32_t acceptSize;
+
+    corto_idmatch_setPrefix *prefixes;
+    int32_t prefixCount;
+    int32_t prefixSize;
+
+    corto_idmatch_setLiteral *literals;
+    uint32_t literalCount;
+    uint32_t literalSize; /* Always a power of two */
+
+    char *strings;
+    uint32_t stringsLength;
+    uint32_t stringsSize;
+
+    int32_t scopeAll;     /* Node with patterns that match any id in scope */
+    int32_t treeAll;      /* Node with patterns that match any id in tree */
+    bool hasTree;         /* Set if patterns were added to the tree */
+
+    corto_idmatch_setFallback *fallback;
+    uint32_t fallbackCount;
+};
+
+static
+int32_t corto_idmatch_setNode_add(
+    corto_idmatch_set set)
+{
+    if (set->nodeCount == set->nodeSize) {
+        set->nodeSize = set->nodeSize ? set->nodeSize * 2 : 32;
+        set->nodes = corto_realloc(
+            set->nodes, set->nodeSize * sizeof(corto_idmatch_setNode));
+    }
+    corto_idmatch_setNode *node = &set->nodes[set->nodeCount];
+    node->gap = -1;
+    node->globs = -1;
+    node->sibling = -1;
+    node->prefixes = -1;
+    node->accept = -1;
+    node->glob = 0;
+    node->isGap = false;
+    node->hasLiterals = false;
+    return set->nodeCount ++;
+}
+
+static
+void corto_idmatch_setNode_accept(
+    corto_idmatch_set set,
+    int32_t node,
+    uint32_t pattern)
+{
+    int32_t a;
+
+    /* Alternatives of the same pattern can end in the same node */
+    for (a = set->nodes[node].accept; a != -1; a = set->accept[a].next) {
+        if (set->accept[a].pattern == pattern) {
+            return;
+        }
+    }
+
+    if (set->acceptCount == set->acceptSize) {
+        set->acceptSize = set->acceptSize ? set->acceptSize * 2 : 32;
+        set->accept = corto_realloc(
+            set->accept, set->acceptSize * sizeof(corto_idmatch_setAccept));
+    }
+    set->accept[set->acceptCount].pattern = pattern;
+    set->accept[set->acceptCount].next = set->nodes[node].accept;
+    set->nodes[node].accept = set->acceptCount ++;
+}
+
+static
+uint32_t corto_idmatch_set_addString(
+    corto_idmatch_set set,
+    const char *str,
+    uint32_t len)
+{
+    uint32_t result = set->stringsLength;
+    if (set->stringsLength + len + 1 > set->stringsSize) {
+        do {
+            set->stringsSize = set->stringsSize ? set->stringsSize * 2 : 256;
+        } while (set->stringsLength + len + 1 > set->stringsSize);
+        set->strings = corto_realloc(set->strings, set->stringsSize);
+    }
+    memcpy(&set->strings[result], str, len);
+    set->strings[result + len] = '\0';
+    set->stringsLength += len + 1;
+    return result;
+}
+
+static
+uint32_t corto_idmatch_setLiteral_hash(
+    int32_t parent,
+    corto_strview str,
+    bool prefix)
+{
+    return corto_strview_ihash(str) +
+        ((uint32_t)parent * 2 + prefix) * 0x9e3779b9u;
+}
+
+/* Find literal or prefix of parent. Returns index of slot, which is empty if
+ * the literal is not in the table. */
+static
+uint32_t corto_idmatch_setLiteral_find(
+    corto_idmatch_set set,
+    int32_t parent,
+    corto_strview str,
+    bool prefix,
+    uint32_t hash)
+{
+    uint32_t mask = set->literalSize - 1, i = hash & mask;
+    corto_idmatch_setLiteral *literal;
+
+    while ((literal = &set->literals[i])->node != -1) {
+        if ((literal->hash == hash) &&
+            (literal->parent == parent) &&
+            (literal->prefix == prefix) &&
+            corto_strview_iequals(
+                CORTO_STRVIEW(&set->strings[literal->str], literal->len), str))
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+static
+void corto_idmatch_setLiteral_grow(
+    corto_idmatch_set set)
+{
+    corto_idmatch_setLiteral *old = set->literals;
+    uint32_t i, oldSize = set->literalSize;
+
+    set->literalSize = oldSize ? oldSize * 2 : 64;
+    set->literals = corto_alloc(
+        set->literalSize * sizeof(corto_idmatch_setLiteral));
+    for (i = 0; i < set->literalSize; i ++) {
+        set->literals[i].node = -1;
+    }
+
+    for (i = 0; i < oldSize; i ++) {
+        if (old[i].node != -1) {
+            uint32_t mask = set->literalSize - 1, slot = old[i].hash & mask;
+            while (set->literals[slot].node != -1) {
+                slot = (slot + 1) & mask;
+            }
+            set->literals[slot] = old[i];
+        }
+    }
+
+    corto_dealloc(old);
+}
+
+/* Find or create entry for literal or prefix. A new entry has no node, which
+ * must be assigned by the caller before the table is modified again. */
+static
+corto_idmatch_setLiteral* corto_idmatch_setLiteral_add(
+    corto_idmatch_set set,
+    int32_t parent,
+    corto_strview str,
+    bool prefix)
+{
+    uint32_t hash = corto_idmatch_setLiteral_hash(parent, str, prefix);
+    corto_idmatch_setLiteral *literal;
+
+    /* Keep load factor below 50% */
+    if ((set->literalCount + 1) * 2 > set->literalSize) {
+        corto_idmatch_setLiteral_grow(set);
+    }
+
+    literal = &set->literals[
+        corto_idmatch_setLiteral_find(set, parent, str, prefix, hash)];
+    if (literal->node == -1) {
+        literal->hash = hash;
+        literal->parent = parent;
+        literal->prefix = prefix;
+        literal->len = str.len;
+        literal->str = corto_idmatch_set_addString(set, str.ptr, str.len);
+        set->literalCount ++;
+    }
+
+    return literal;
+}
+
+static
+int32_t corto_idmatch_setLiteral_lookup(
+    corto_idmatch_set set,
+    int32_t parent,
+    corto_strview str,
+    bool prefix)
+{
+    if (!set->literalCount) {
+        return -1;
+    }
+    uint32_t hash = corto_idmatch_setLiteral_hash(parent, str, prefix);
+    return set->literals[
+        corto_idmatch_setLiteral_find(set, parent, str, prefix, hash)].node;
+}
+
+/* Find or create node for literal under parent */
+static
+int32_t corto_idmatch_setLiteral_child(
+    corto_idmatch_set set,
+    int32_t parent,
+    const char *str)
+{
+    corto_idmatch_setLiteral *literal = corto_idmatch_setLiteral_add(
+        set, parent, corto_strview_from(str), false);
+
+    if (literal->node == -1) {
+        literal->node = corto_idmatch_setNode_add(set);
+        if (parent >= 0) {
+            set->nodes[parent].hasLiterals = true;
+        }
+    }
+
+    return literal->node;
+}
+
+static
+void corto_idmatch_setPrefix_add(
+    corto_idmatch_set set,
+    int32_t parent,
+    uint32_t len)
+{
+    int32_t p;
+
+    for (p = set->nodes[parent].prefixes; p != -1; p = set->prefixes[p].next) {
+        if (set->prefixes[p].len == len) {
+            return;
+        }
+    }
+
+    if (set->prefixCount == set->prefixSize) {
+        set->prefixSize = set->prefixSize ? set->prefixSize * 2 : 32;
+        set->prefixes = corto_realloc(
+            set->prefixes, set->prefixSize * sizeof(corto_idmatch_setPrefix));
+    }
+    set->prefixes[set->prefixCount].len = len;
+    set->prefixes[set->prefixCount].next = set->nodes[parent].prefixes;
+    set->nodes[parent].prefixes = set->prefixCount ++;
+}
+
+/* Find or create node for filter under parent */
+static
+int32_t corto_idmatch_setGlob_child(
+    corto_idmatch_set set,
+    int32_t parent,
+    const char *glob)
+{
+    corto_idmatch_setLiteral *literal = NULL;
+    uint32_t len = strcspn(glob, "*?");
+    int32_t first, node;
+
+    if (len) {
+        literal = corto_idmatch_setLiteral_add(
+            set, parent, CORTO_STRVIEW(glob, len), true);
+        first = literal->node;
+        if (first == -1) {
+            corto_idmatch_setPrefix_add(set, parent, len);
+        }
+    } else {
+        first = set->nodes[parent].globs;
+    }
+
+    for (node = first; node != -1; node = set->nodes[node].sibling) {
+        if (!strcmp(&set->strings[set->nodes[node].glob], &glob[len])) {
+            return node;
+        }
+    }
+
+    node = corto_idmatch_setNode_add(set);
+    set->nodes[node].glob = corto_idmatch_set_addString(
+        set, &glob[len], strlen(&glob[len]));
+    set->nodes[node].sibling = first;
+    if (literal) {
+        literal->node = node;
+    } else {
+        set->nodes[parent].globs = node;
+    }
+
+    return node;
+}
+
+/* Find or create gap node under parent */
+static
+int32_t corto_idmatch_setGap_child(
+    corto_idmatch_set set,
+    int32_t parent)
+{
+    if (set->nodes[parent].gap == -1) {
+        int32_t node = corto_idmatch_setNode_add(set);
+        set->nodes[node].isGap = true;
+        set->nodes[parent].gap = node;
+    }
+    return set->nodes[parent].gap;
+}
+
+/* Test if alternative can be added to the tree. Mirrors the checks of the
+ * automaton compiler. */
+static
+bool corto_idmatch_set_supported(
+    corto_idmatchOp *op,
+    corto_idmatchOp *end)
+{
+    corto_idmatchOp *cur;
+
+    if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        op ++;
+    }
+
+    if ((end == op) ||
+        ((end[-1].token != CORTO_MATCHER_TOKEN_IDENTIFIER) &&
+         (end[-1].token != CORTO_MATCHER_TOKEN_FILTER)) ||
+        (op->token == CORTO_MATCHER_TOKEN_SCOPE))
+    {
+        return false;
+    }
+
+    for (cur = op; cur < end; cur ++) {
+        switch(cur->token) {
+        case CORTO_MATCHER_TOKEN_IDENTIFIER:
+        case CORTO_MATCHER_TOKEN_FILTER:
+        case CORTO_MATCHER_TOKEN_SCOPE:
+        case CORTO_MATCHER_TOKEN_TREE:
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Iterate over alternatives of program. Returns false if all alternatives have
+ * been visited. */
+static
+bool corto_idmatch_set_nextAlternative(
+    corto_idmatch_program program,
+    corto_idmatchOp **op,
+    corto_idmatchOp **end)
+{
+    if (!*end) {
+        *op = program->ops;
+    } else if ((*end)->token == CORTO_MATCHER_TOKEN_SEPARATOR) {
+        *op = *end + 1;
+    } else {
+        return false;
+    }
+
+    *end = *op;
+    while (((*end)->token != CORTO_MATCHER_TOKEN_NONE) &&
+           ((*end)->token != CORTO_MATCHER_TOKEN_SEPARATOR))
+    {
+        (*end) ++;
+    }
+
+    return true;
+}
+
+static
+void corto_idmatch_set_addAlternative(
+    corto_idmatch_set set,
+    corto_idmatchOp *op,
+    corto_idmatchOp *end,
+    uint32_t pattern)
+{
+    int32_t node = 0; /* Root */
+    corto_idmatchOp *cur;
+
+    if (op->token == CORTO_MATCHER_TOKEN_SCOPE) {
+        op ++;
+    }
+
+    for (cur = op; cur < end; cur ++) {
+        switch(cur->token) {
+        case CORTO_MATCHER_TOKEN_IDENTIFIER:
+            node = corto_idmatch_setLiteral_child(set, node, cur->start);
+            break;
+        case CORTO_MATCHER_TOKEN_FILTER:
+            node = corto_idmatch_setGlob_child(set, node, cur->start);
+            break;
+        case CORTO_MATCHER_TOKEN_TREE:
+            node = corto_idmatch_setGap_child(set, node);
+            break;
+        default:
+            /* Scope operators separate elements */
+            break;
+        }
+    }
+
+    corto_idmatch_setNode_accept(set, node, pattern);
+    set->hasTree = true;
+}
+
+static
+int16_t corto_idmatch_set_add(
+    corto_idmatch_set set,
+    corto_idmatch_program program,
+    uint32_t pattern)
+{
+    corto_idmatchOp *op = NULL, *end = NULL;
+    bool supported = true;
+
+    switch(program->kind) {
+    case 2:
+        corto_idmatch_setNode_accept(set, corto_idmatch_setLiteral_child(
+            set, CORTO_IDMATCH_SET_ID, "."), pattern);
+        return 0;
+    case 3:
+        corto_idmatch_setNode_accept(set, set->scopeAll, pattern);
+        return 0;
+    case 4:
+        corto_idmatch_setNode_accept(set, set->treeAll, pattern);
+        return 0;
+    default:
+        break;
+    }
+
+    while (supported && corto_idmatch_set_nextAlternative(program, &op, &end)) {
+        supported = corto_idmatch_set_supported(op, end);
+    }
+
+    if (!supported) {
+        /* Program is matched by itself, set takes ownership */
+        set->fallback = corto_realloc(set->fallback,
+            (set->fallbackCount + 1) * sizeof(corto_idmatch_setFallback));
+        set->fallback[set->fallbackCount].pattern = pattern;
+        set->fallback[set->fallbackCount].program = program;
+        set->fallbackCount ++;
+        return 1;
+    }
+
+    op = end = NULL;
+    while (corto_idmatch_set_nextAlternative(program, &op, &end)) {
+        corto_idmatch_set_addAlternative(set, op, end, pattern);
+    }
+
+    return 0;
+}
+
+corto_idmatch_set corto_idmatch_set_compile(
+    const char *patterns[],
+    uint32_t count)
+{
+    corto_idmatch_set set = corto_calloc(sizeof(struct corto_idmatch_set_s));
+    uint32_t i;
+
+    set->count = count;
+    corto_idmatch_setNode_add(set); /* Root */
+    set->scopeAll = corto_idmatch_setNode_add(set);
+    set->treeAll = corto_idmatch_setNode_add(set);
+
+    for (i = 0; i < count; i ++) {
+        corto_idmatch_program program = corto_idmatch_compileFlags(
+            patterns[i],
+            CORTO_IDMATCH_ALLOW_SCOPES |
+            CORTO_IDMATCH_ALLOW_SEPARATORS |
+            CORTO_IDMATCH_NO_DFA);
+        if (!program) {
+            corto_throw("invalid pattern %u ('%s') in set", i, patterns[i]);
+            goto error;
+        }
+
+        if (!corto_idmatch_set_add(set, program, i)) {
+            corto_idmatch_free(program);
+        }
+    }
+
+    return set;
+error:
+    corto_idmatch_set_free(set);
+    return NULL;
+}
+
+static
+void corto_idmatch_set_accept(
+    corto_idmatch_set set,
+    int32_t node,
+    uint64_t *bitset,
+    uint32_t *count)
+{
+    int32_t a;
+    for (a = set->nodes[node].accept; a != -1; a = set->accept[a].next) {
+        uint32_t pattern = set->accept[a].pattern;
+        uint64_t bit = 1ull << (pattern & 63);
+        if (!(bitset[pattern >> 6] & bit)) {
+            bitset[pattern >> 6] |= bit;
+            (*count) ++;
+        }
+    }
+}
+
+/* Add node and its gap child to list of active nodes, if not yet added */
+static
+void corto_idmatch_set_activate(
+    corto_idmatch_set set,
+    int32_t node,
+    int32_t *active,
+    int32_t *activeCount,
+    uint64_t *added)
+{
+    do {
+        uint64_t bit = 1ull << (node & 63);
+        if (!(added[node >> 6] & bit)) {
+            added[node >> 6] |= bit;
+            active[(*activeCount) ++] = node;
+        }
+        node = set->nodes[node].gap;
+    } while (node != -1);
+}
+
+/* Activate filters in list that match element */
+static
+void corto_idmatch_set_matchGlobs(
+    corto_idmatch_set set,
+    int32_t node,
+    corto_strview elem,
+    int32_t *active,
+    int32_t *activeCount,
+    uint64_t *added)
+{
+    for (; node != -1; node = set->nodes[node].sibling) {
+        if (corto_idmatch_glob(&set->strings[set->nodes[node].glob], elem)) {
+            corto_idmatch_set_activate(set, node, active, activeCount, added);
+        }
+    }
+}
+
+static
+void corto_idmatch_set_runTree(
+    corto_idmatch_set set,
+    const char *id,
+    uint64_t *bitset,
+    uint32_t *count)
+{
+    int32_t nodeCount = set->nodeCount, words = (nodeCount + 63) / 64;
+    size_t size = (2 * nodeCount * sizeof(int32_t)) + words * sizeof(uint64_t);
+    uint64_t stack[CORTO_IDMATCH_SET_STACK / sizeof(uint64_t)], *buffer = stack;
+    corto_strview remaining, elem;
+    int32_t *active, *next, activeCount = 0, nextCount, i;
+    uint64_t *added;
+
+    /* Skip leading '/' in the same way as the automaton */
+    if (id[0] == '/') {
+        id ++;
+        if (id[0] == '/') {
+            id ++;
+        } else if (!id[0]) {
+            return;
+        }
+    } else if (!id[0]) {
+        return;
+    }
+
+    if (size > sizeof(stack)) {
+        buffer = corto_alloc(size);
+    }
+    added = buffer;
+    active = (int32_t*)(added + words);
+    next = active + nodeCount;
+    memset(added, 0, words * sizeof(uint64_t));
+
+    corto_idmatch_set_activate(set, 0, active, &activeCount, added);
+    for (i = 0; i < activeCount; i ++) {
+        added[active[i] >> 6] = 0;
+    }
+
+    remaining = corto_strview_from(id);
+    do {
+        /* An id that ends with a '/' ends with an empty element */
+        ptrdiff_t sep = corto_strview_find(remaining, '/');
+        if (sep == -1) {
+            elem = remaining;
+            remaining.ptr = NULL;
+        } else {
+            elem = corto_strview_slice(remaining, 0, sep);
+            remaining = corto_strview_slice(
+                remaining, sep + 1, remaining.len - sep - 1);
+        }
+
+        bool hidden = elem.len && (elem.ptr[0] == '.');
+        nextCount = 0;
+        for (i = 0; i < activeCount; i ++) {
+            corto_idmatch_setNode *node = &set->nodes[active[i]];
+            int32_t child, p;
+
+            if (node->isGap) {
+                corto_idmatch_set_activate(
+                    set, active[i], next, &nextCount, added);
+            }
+            if (hidden) {
+                continue;
+            }
+            if (node->hasLiterals && elem.len) {
+                child = corto_idmatch_setLiteral_lookup(
+                    set, active[i], elem, false);
+                if (child != -1) {
+                    corto_idmatch_set_activate(
+                        set, child, next, &nextCount, added);
+                }
+            }
+            for (p = node->prefixes; p != -1; p = set->prefixes[p].next) {
+                uint32_t len = set->prefixes[p].len;
+                if (len <= elem.len) {
+                    corto_idmatch_set_matchGlobs(set,
+                        corto_idmatch_setLiteral_lookup(set, active[i],
+                            corto_strview_slice(elem, 0, len), true),
+                        corto_strview_slice(elem, len, elem.len - len),
+                        next, &nextCount, added);
+                }
+            }
+            corto_idmatch_set_matchGlobs(
+                set, node->globs, elem, next, &nextCount, added);
+        }
+
+        /* Clear only the bits that were set */
+        for (i = 0; i < nextCount; i ++) {
+            added[next[i] >> 6] = 0;
+        }
+
+        int32_t *tmp = active;
+        active = next;
+        next = tmp;
+        activeCount = nextCount;
+    } while (activeCount && remaining.ptr);
+
+    if (!remaining.ptr) {
+        for (i = 0; i < activeCount; i ++) {
+            corto_idmatch_set_accept(set, active[i], bitset, count);
+        }
+    }
+
+    if (buffer != stack) {
+        corto_dealloc(buffer);
+    }
+}
+
+uint32_t corto_idmatch_set_run(
+    corto_idmatch_set set,
+    const char *id,
+    uint64_t *bitset_out)
+{
+    uint32_t i, count = 0;
+    int32_t node;
+    const char *ptr;
+
+    memset(bitset_out, 0, ((set->count + 63) / 64) * sizeof(uint64_t));
+
+    /* Identifiers and '.' */
+    node = corto_idmatch_setLiteral_lookup(
+        set, CORTO_IDMATCH_SET_ID, corto_strview_from(id), false);
+    if (node != -1) {
+        corto_idmatch_set_accept(set, node, bitset_out, &count);
+    }
+
+    /* Any identifier in scope */
+    ptr = id;
+    if (ptr[0] == '/') ptr ++;
+    if (!strchr(ptr, '/')) {
+        corto_idmatch_set_accept(set, set->scopeAll, bitset_out, &count);
+    }
+
+    /* Any identifier in tree */
+    if (strcmp(id, ".")) {
+        corto_idmatch_set_accept(set, set->treeAll, bitset_out, &count);
+    }
+
+    if (set->hasTree) {
+        corto_idmatch_set_runTree(set, id, bitset_out, &count);
+    }
+
+    for (i = 0; i < set->fallbackCount; i ++) {
+        uint32_t pattern = set->fallback[i].pattern;
+        if (corto_idmatch_run(set->fallback[i].program, id)) {
+            bitset_out[pattern >> 6] |= 1ull << (pattern & 63);
+            count ++;
+        }
+    }
+
+    return count;
+}
+
+uint32_t corto_idmatch_set_count(
+    corto_idmatch_set set)
+{
+    return set->count;
+}
+
+void corto_idmatch_set_free(
+    corto_idmatch_set set)
+{
+    if (set) {
+        uint32_t i;
+        for (i = 0; i < set->fallbackCount; i ++) {
+            corto_idmatch_free(set->fallback[i].program);
+        }
+        corto_dealloc(set->fallback);
+        corto_dealloc(set->nodes);
+        corto_dealloc(set->accept);
+        corto_dealloc(set->prefixes);
+        corto_dealloc(set->literals);
+        corto_dealloc(set->strings);
+        corto_dealloc(set);
+    }
+}
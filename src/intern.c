@@ -0,0 +1,269 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "base.h"
+
+/* The intern pool stores a single copy of each string. Entries are never freed
+ * while the pool is alive, so the returned pointers can be used as handles that
+ * are compared with '=='. The case-insensitive table maps a string to the first
+ * spelling that was interned with corto_strinterni. Both tables store the hash
+ * of the slot next to the entry, which for the case-insensitive table is the
+ * hash of the folded string, so most probes don't compare strings. */
+
+typedef struct corto_strintern_entry {
+    uint32_t hash;
+    uint32_t length;
+    char str[];
+} corto_strintern_entry;
+
+typedef struct corto_strintern_slot {
+    uint32_t hash;
+    corto_strintern_entry *entry; /* NULL if slot is empty */
+} corto_strintern_slot;
+
+typedef struct corto_strintern_table {
+    corto_strintern_slot *slots;
+    uint32_t size; /* Always a power of two */
+    uint32_t count;
+} corto_strintern_table;
+
+/* Start with a small table, grow at 70% load */
+#define CORTO_STRINTERN_MIN_SIZE (64)
+#define CORTO_STRINTERN_LOAD(size) (((size) / 10) * 7)
+
+extern corto_rwmutex_s corto_intern_lock;
+
+static corto_strintern_table corto_strintern_exact;
+static corto_strintern_table corto_strintern_fold;
+static size_t corto_strintern_bytes;
+
+static
+corto_strintern_entry* corto_strintern_lookup(
+    corto_strintern_table *table,
+    const char *str,
+    uint32_t hash,
+    bool ignoreCase)
+{
+    if (!table->size) {
+        return NULL;
+    }
+
+    uint32_t mask = table->size - 1;
+    uint32_t i = hash & mask;
+    corto_strintern_entry *e;
+
+    while ((e = table->slots[i].entry)) {
+        if (table->slots[i].hash == hash) {
+            if (ignoreCase ? !stricmp(e->str, str) : !strcmp(e->str, str)) {
+                return e;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+static
+void corto_strintern_insert(
+    corto_strintern_table *table,
+    corto_strintern_entry *entry,
+    uint32_t hash);
+
+static
+void corto_strintern_grow(
+    corto_strintern_table *table)
+{
+    corto_strintern_table old = *table;
+    uint32_t i;
+
+    table->size = old.size ? old.size * 2 : CORTO_STRINTERN_MIN_SIZE;
+    table->slots = corto_calloc(table->size * sizeof(corto_strintern_slot));
+    table->count = 0;
+
+    for (i = 0; i < old.size; i ++) {
+        if (old.slots[i].entry) {
+            corto_strintern_insert(
+                table, old.slots[i].entry, old.slots[i].hash);
+        }
+    }
+
+    corto_dealloc(old.slots);
+}
+
+static
+void corto_strintern_insert(
+    corto_strintern_table *table,
+    corto_strintern_entry *entry,
+    uint32_t hash)
+{
+    if (table->count >= CORTO_STRINTERN_LOAD(table->size)) {
+        corto_strintern_grow(table);
+    }
+
+    uint32_t mask = table->size - 1;
+    uint32_t i = hash & mask;
+    while (table->slots[i].entry) {
+        i = (i + 1) & mask;
+    }
+
+    table->slots[i].hash = hash;
+    table->slots[i].entry = entry;
+    table->count ++;
+}
+
+/* Find or add an entry to the exact table. Must be called with write lock. */
+static
+corto_strintern_entry* corto_strintern_add(
+    const char *str,
+    uint32_t hash)
+{
+    corto_strintern_entry *e = corto_strintern_lookup(
+        &corto_strintern_exact, str, hash, false);
+
+    if (!e) {
+        uint32_t length = strlen(str);
+        e = corto_alloc(sizeof(corto_strintern_entry) + length + 1);
+        e->hash = hash;
+        e->length = length;
+        memcpy(e->str, str, length + 1);
+        corto_strintern_insert(&corto_strintern_exact, e, hash);
+        corto_strintern_bytes += sizeof(corto_strintern_entry) + length + 1;
+    }
+
+    return e;
+}
+
+static
+const char* corto_strintern_intern(
+    const char *str,
+    bool ignoreCase)
+{
+    corto_strintern_table *table =
+        ignoreCase ? &corto_strintern_fold : &corto_strintern_exact;
+    uint32_t hash = ignoreCase ? strihash(str) : strhash(str);
+    corto_strintern_entry *e;
+
+    /* Fast path: string is already in the pool */
+    if (corto_rwmutex_read(&corto_intern_lock)) {
+        goto error;
+    }
+    e = corto_strintern_lookup(table, str, hash, ignoreCase);
+    if (corto_rwmutex_unlock(&corto_intern_lock)) {
+        goto error;
+    }
+
+    if (!e) {
+        if (corto_rwmutex_write(&corto_intern_lock)) {
+            goto error;
+        }
+
+        /* Test again, string could have been added in between locks */
+        e = corto_strintern_lookup(table, str, hash, ignoreCase);
+        if (!e) {
+            if (ignoreCase) {
+                e = corto_strintern_add(str, strhash(str));
+                corto_strintern_insert(&corto_strintern_fold, e, hash);
+            } else {
+                e = corto_strintern_add(str, hash);
+            }
+        }
+
+        if (corto_rwmutex_unlock(&corto_intern_lock)) {
+            goto error;
+        }
+    }
+
+    return e->str;
+error:
+    return NULL;
+}
+
+const char* corto_strintern(
+    const char *str)
+{
+    if (!str) {
+        return NULL;
+    }
+    return corto_strintern_intern(str, false);
+}
+
+const char* corto_strinterni(
+    const char *str)
+{
+    if (!str) {
+        return NULL;
+    }
+    return corto_strintern_intern(str, true);
+}
+
+const char* corto_strintern_find(
+    const char *str)
+{
+    corto_strintern_entry *e;
+
+    if (!str) {
+        return NULL;
+    }
+
+    if (corto_rwmutex_read(&corto_intern_lock)) {
+        return NULL;
+    }
+    e = corto_strintern_lookup(
+        &corto_strintern_exact, str, strhash(str), false);
+    corto_rwmutex_unlock(&corto_intern_lock);
+
+    return e ? e->str : NULL;
+}
+
+void corto_strintern_stats(
+    corto_strintern_stats_t *stats_out)
+{
+    if (corto_rwmutex_read(&corto_intern_lock)) {
+        corto_throw(NULL);
+        return;
+    }
+
+    stats_out->count = corto_strintern_exact.count;
+    stats_out->foldCount = corto_strintern_fold.count;
+    stats_out->bytes = corto_strintern_bytes;
+    stats_out->tableBytes =
+        (corto_strintern_exact.size + corto_strintern_fold.size) *
+        sizeof(corto_strintern_slot);
+
+    corto_rwmutex_unlock(&corto_intern_lock);
+}
+
+void corto_strintern_deinit(void) {
+    uint32_t i;
+
+    for (i = 0; i < corto_strintern_exact.size; i ++) {
+        if (corto_strintern_exact.slots[i].entry) {
+            corto_dealloc(corto_strintern_exact.slots[i].entry);
+        }
+    }
+
+    corto_dealloc(corto_strintern_exact.slots);
+    corto_dealloc(corto_strintern_fold.slots);
+    memset(&corto_strintern_exact, 0, sizeof(corto_strintern_table));
+    memset(&corto_strintern_fold, 0, sizeof(corto_strintern_table));
+    corto_strintern_bytes = 0;
+}
@@ -36,7 +36,8 @@ static const char *corto_build;
 extern corto_mutex_s corto_load_lock;
 
 struct corto_loadedAdmin {
-    char* name;
+    const char* name;
+    const char* path; /* Interned path, used for lookups */
     corto_thread loading;
     int16_t result;
     corto_dl library;
@@ -105,14 +106,19 @@ struct corto_loadedAdmin* corto_loadedAdminFind(
     if (loadedAdmin) {
         corto_iter iter = corto_ll_iter(loadedAdmin);
         struct corto_loadedAdmin *lib;
-        corto_id libPath, adminPath;
-
-        corto_ptr_castToPath(name, libPath);
+        corto_id libPath;
+
+        /* Loaded paths are interned, so a path that isn't in the pool isn't
+         * loaded. */
+        const char *path =
+            corto_strintern_find(corto_ptr_castToPath(name, libPath));
+        if (!path) {
+            return NULL;
+        }
 
         while (corto_iter_hasNext(&iter)) {
             lib = corto_iter_next(&iter);
-            corto_ptr_castToPath(lib->name, adminPath);
-            if (!strcmp(adminPath, libPath)) {
+            if (lib->path == path) {
                 return lib;
             }
         }
@@ -127,7 +133,9 @@ struct corto_loadedAdmin* corto_loadedAdminAdd(
     const char* library)
 {
     struct corto_loadedAdmin *lib = corto_calloc(sizeof(struct corto_loadedAdmin));
-    lib->name = corto_strdup(library);
+    corto_id libPath;
+    lib->name = corto_strintern(library);
+    lib->path = corto_strintern(corto_ptr_castToPath(library, libPath));
     lib->loading = corto_thread_self();
     if (!loadedAdmin) {
         loadedAdmin = corto_ll_new();
@@ -938,7 +946,6 @@ void corto_loaderOnExit(
         iter = corto_ll_iter(loadedAdmin);
          while(corto_iter_hasNext(&iter)) {
              struct corto_loadedAdmin *loaded = corto_iter_next(&iter);
-             free(loaded->name);
              if (loaded->filename) free(loaded->filename);
              if (loaded->base) free(loaded->base);
              free(loaded);
@@ -63,7 +63,7 @@ typedef struct corto_log_codeframe {
 
 /* One frame for each category */
 typedef struct corto_log_frame {
-    char *category;
+    char *category; /* Interned with corto_strintern, not owned by frame */
     int count;
     bool printed;
 
@@ -1073,7 +1073,6 @@ void corto_log_setError(
         int i;
         for (i = 1; i <= data->sp; i ++) {
             data->exceptionFrames[i - 1] = data->frames[data->sp - i];
-            data->exceptionFrames[i - 1].category = strdup(data->frames[data->sp - i].category);
             data->exceptionFrames[i - 1].initial.file = strdup(data->frames[data->sp - i].initial.file);
             data->exceptionFrames[i - 1].initial.function = strdup(data->frames[data->sp - i].initial.function);
             data->exceptionFrames[i - 1].sp = 0;
@@ -1297,7 +1296,7 @@ int _corto_log_push(
 
     corto_log_frame *frame = &data->frames[data->sp];
 
-    frame->category = category ? strdup(category) : NULL;
+    frame->category = (char*)corto_strintern(category);
     data->categories[data->sp] = frame->category;
     frame->count = 0;
     frame->printed = false;
@@ -1349,7 +1348,6 @@ void _corto_log_pop(
 
         if (frame->initial.file) free(frame->initial.file);
         if (frame->initial.function) free(frame->initial.function);
-        if (frame->category) free(frame->category);
         frame->sp = 0;
 
         data->frames[data->sp - 1].count += data->frames[data->sp].count;
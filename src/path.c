@@ -21,99 +21,96 @@
 
 #include <corto/platform.h>
 
-static
-char *__strsep(char **str, char delim) {
-    char *result = *str;
-    if (result) {
-        char *ptr = strchr(result, delim);
-        if (ptr) {
-            *ptr = 0;
-            (*str) = ptr + 1;
-        } else {
-            *str = NULL;
-        }
-    }
-    return result;
-}
-
-char* corto_path_clean(char *buf, char *path) {
-    char work[CORTO_MAX_PATH_LENGTH], tempbuf[CORTO_MAX_PATH_LENGTH];
-    char *cp, *thisp, *nextp = work;
-    bool threadStr = false;
-    bool equalBuf = true;
-
-    if (!buf) {
-        buf = corto_alloc(CORTO_MAX_PATH_LENGTH);
-        threadStr = true;
-    } else if (buf == path) {
-        equalBuf = true;
-        buf = tempbuf;
-    }
-
-    cp = strchr(path, '/');
-
-    /* no '/' characters - return as-is */
-    if (cp == NULL) {
-        return path;
+char* corto_path_cleanView(char *buf, corto_strview path) {
+    char tempbuf[CORTO_MAX_PATH_LENGTH];
+    char *out = buf ? buf : tempbuf;
+    corto_strview elem;
+    size_t len = 0;
+
+    /* Result is never longer than the input, except for "" which becomes "." */
+    if (path.len >= CORTO_MAX_PATH_LENGTH) {
+        corto_throw("path exceeds %d characters", CORTO_MAX_PATH_LENGTH - 1);
+        goto error;
     }
 
     /* copy leading slash if present */
-    if (cp == path) {
-        strcpy(buf, "/");
-    } else {
-        buf[0] = '\0';
+    if (path.len && path.ptr[0] == '/') {
+        out[len ++] = '/';
     }
 
     /* tokenization */
-    strcpy(work, path);
-    while ((thisp = __strsep(&nextp, '/')) != NULL) {
-        if (*thisp == '\0') continue;
+    while (corto_strview_next(&path, '/', &elem)) {
+        if (!elem.len) continue;
 
-        if (strcmp(thisp, ".") == 0) continue;
+        if (elem.len == 1 && elem.ptr[0] == '.') continue;
 
-        if (strcmp(thisp, "..") == 0) {
-            cp = strrchr(buf, '/');
+        if (elem.len == 2 && elem.ptr[0] == '.' && elem.ptr[1] == '.') {
+            /* Find last '/' in result */
+            size_t sep = len;
+            while (sep && out[sep - 1] != '/') {
+                sep --;
+            }
 
              /* "/" or "/foo" */
-            if (cp == buf) {
-                buf[1] = '\0';
+            if (sep == 1) {
+                len = 1;
                 continue;
             }
 
             /* "..", "foo", or "" */
-            else if (cp == NULL) {
-                if (buf[0] != '\0' && strcmp(buf, "..") != 0) {
-                    buf[0] = '\0';
+            else if (!sep) {
+                if (len && !(len == 2 && out[0] == '.' && out[1] == '.')) {
+                    len = 0;
                     continue;
                 }
             }
             /* ".../foo" */
             else {
-                *cp = '\0';
+                len = sep - 1;
                 continue;
             }
         }
 
-        if (buf[0] != '\0' && buf[strlen(buf) - 1] != '/') {
-            strcat(buf, "/");
+        if (len && out[len - 1] != '/') {
+            out[len ++] = '/';
         }
 
-        strcat(buf, thisp);
+        memcpy(&out[len], elem.ptr, elem.len);
+        len += elem.len;
     }
 
-    if (buf[0] == '\0') strcpy(buf, ".");
+    if (!len) out[len ++] = '.';
+    out[len] = '\0';
 
-    if (threadStr) {
-        char *tmp = buf;
-        path = corto_setThreadString(buf);
-        corto_dealloc(tmp);
-    } else if (equalBuf) {
-        strcpy(path, buf);
-    } else {
-        path = buf;
+    if (!buf) {
+        return corto_setThreadStringView(CORTO_STRVIEW(out, len));
+    }
+
+    return buf;
+error:
+    return NULL;
+}
+
+char* corto_path_clean(char *buf, char *path) {
+    char tempbuf[CORTO_MAX_PATH_LENGTH];
+
+    /* no '/' characters - return as-is */
+    if (!strchr(path, '/')) {
+        return path;
+    }
+
+    /* Clean into temporary buffer when cleaning in place */
+    if (buf && buf == path) {
+        if (!corto_path_cleanView(tempbuf, corto_strview_from(path))) {
+            goto error;
+        }
+        strcpy(path, tempbuf);
+        return path;
     }
 
-    return path;
+    return corto_path_cleanView(buf, corto_strview_from(path));
+error:
+    return NULL;
 }
 
 char* corto_path_dirname(
@@ -7,9 +7,19 @@ int8_t CORTO_BACKTRACE_ENABLED = 0;
 corto_mutex_s corto_log_lock;
 corto_mutex_s corto_load_lock;
 
+/* Lock to protect string intern pool */
+corto_rwmutex_s corto_intern_lock;
+
+/* Lock to protect cache of compiled id expressions */
+corto_mutex_s corto_idmatch_lock;
+
+/* Lock to protect creation of the shared thread pool */
+corto_mutex_s corto_pool_lock;
+
 extern char *corto_log_appName;
 
 corto_tls CORTO_KEY_THREAD_STRING;
+corto_tls CORTO_KEY_POOL_WORKER;
 
 void platform_init(char *appName) {
     corto_log_appName = appName;
@@ -22,12 +32,28 @@ void platform_init(char *appName) {
         corto_critical("failed to create mutex for package loader");
     }
 
+    if (corto_rwmutex_new(&corto_intern_lock)) {
+        corto_critical("failed to create mutex for string intern pool");
+    }
+
+    if (corto_mutex_new(&corto_idmatch_lock)) {
+        corto_critical("failed to create mutex for id expression cache");
+    }
+
+    if (corto_mutex_new(&corto_pool_lock)) {
+        corto_critical("failed to create mutex for thread pool");
+    }
+
     void corto_threadStringDealloc(void *data);
 
     if (corto_tls_new(&CORTO_KEY_THREAD_STRING, corto_threadStringDealloc)) {
         corto_critical("failed to obtain tls key for thread admin");
     }
 
+    if (corto_tls_new(&CORTO_KEY_POOL_WORKER, NULL)) {
+        corto_critical("failed to obtain tls key for thread pool");
+    }
+
     if (corto_log_init()) {
         corto_critical("failed to initialize logging framework");
     }
@@ -71,5 +97,8 @@ void platform_init(char *appName) {
 }
 
 void platform_deinit(void) {
+    corto_pool_deinit();
     corto_tls_free();
+    corto_idmatch_cache_deinit();
+    corto_strintern_deinit();
 }
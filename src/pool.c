@@ -0,0 +1,714 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "base.h"
+
+/* The deque of a worker is a Chase-Lev deque. The worker pushes and takes
+ * tasks at the bottom, other threads steal tasks from the top. Only a take and
+ * a steal of the last task compete, which is resolved with a CAS on top.
+ *
+ * Idle workers sleep on a semaphore. A worker that goes to sleep increments
+ * sleeping and checks once more for tasks. A thread that submits a task
+ * decrements sleeping if it isn't zero, and posts the semaphore once for every
+ * decrement. A worker that finds a task after incrementing sleeping undoes its
+ * increment, or if a submitter already did, consumes the post.
+ *
+ * A thread waiting for a group that finds no tasks sleeps on a semaphore of
+ * its own, which it adds to the list of waiters of the pool. Waiters can't
+ * share a semaphore, as a post for a waiter of which the group is done could
+ * be consumed by a waiter that goes back to sleep. The thread that finishes the
+ * last task of a group wakes the waiters of that group. A task that is
+ * submitted while no worker sleeps wakes one waiter, as the waiting thread may
+ * be the only worker that can run it. */
+
+/* Initial number of tasks in the deque of a worker */
+#define CORTO_POOL_DEQUE_SIZE (256)
+
+/* Maximum number of workers of the shared pool */
+#define CORTO_POOL_MAX_WORKERS (1024)
+
+/* Number of times an idle thread looks for tasks before it sleeps or yields */
+#define CORTO_POOL_SPIN (64)
+
+extern corto_mutex_s corto_pool_lock;
+extern corto_tls CORTO_KEY_POOL_WORKER;
+
+/* Lives on the stack of a waiting thread while it sleeps */
+typedef struct corto_pool_waiter {
+    corto_sem sem;
+    corto_pool_group *group;
+    struct corto_pool_waiter *next;
+} corto_pool_waiter;
+
+typedef struct corto_pool_task {
+    corto_pool_cb action;
+    void *arg;
+    corto_pool_group *group;
+} corto_pool_task;
+
+/* Rings are replaced when full. Stealers can still read a replaced ring, so
+ * replaced rings are kept until the pool is freed. */
+typedef struct corto_pool_ring {
+    int64_t size; /* Always a power of two */
+    struct corto_pool_ring *prev;
+    corto_pool_task *tasks[];
+} corto_pool_ring;
+
+/* Top and bottom are stored on different cache lines, so that stealing from a
+ * worker doesn't slow down the worker itself. */
+typedef struct corto_pool_worker {
+    int64_t top;
+    char pad1[56];
+    int64_t bottom;
+    corto_pool_ring *ring;
+    corto_pool pool;
+    corto_thread thread;
+    uint32_t seed;
+    char pad2[28];
+} corto_pool_worker;
+
+struct corto_pool_s {
+    corto_pool_worker *workers;
+    uint32_t workerCount;
+
+    /* Tasks submitted by threads that aren't a worker of the pool */
+    corto_mutex_s lock;
+    corto_pool_task **queue;
+    uint32_t queueHead;
+    uint32_t queueCount; /* Read without lock to check if queue is empty */
+    uint32_t queueSize;
+
+    uint32_t victim; /* First worker robbed by threads that aren't a worker */
+
+    corto_sem wake;
+    int32_t sleeping;
+
+    corto_mutex_s waitLock;
+    corto_pool_waiter *waiters;
+    int32_t waiting; /* Read without lock to check if waiters is empty */
+
+    int32_t stop;
+};
+
+static corto_pool corto_pool_shared;
+
+static
+corto_pool_ring* corto_pool_ringNew(
+    int64_t size)
+{
+    corto_pool_ring *ring = corto_alloc(
+        sizeof(corto_pool_ring) + size * sizeof(corto_pool_task*));
+    ring->size = size;
+    ring->prev = NULL;
+    return ring;
+}
+
+/* Called by the worker that owns the deque */
+static
+void corto_pool_push(
+    corto_pool_worker *worker,
+    corto_pool_task *task)
+{
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+    corto_pool_ring *ring = __atomic_load_n(&worker->ring, __ATOMIC_RELAXED);
+
+    if (b - t >= ring->size) {
+        corto_pool_ring *grown = corto_pool_ringNew(ring->size * 2);
+        int64_t i;
+        for (i = t; i < b; i ++) {
+            __atomic_store_n(&grown->tasks[i & (grown->size - 1)],
+                __atomic_load_n(&ring->tasks[i & (ring->size - 1)],
+                    __ATOMIC_RELAXED),
+                __ATOMIC_RELAXED);
+        }
+        grown->prev = ring;
+        __atomic_store_n(&worker->ring, grown, __ATOMIC_RELEASE);
+        ring = grown;
+    }
+
+    __atomic_store_n(
+        &ring->tasks[b & (ring->size - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+/* Called by the worker that owns the deque */
+static
+corto_pool_task* corto_pool_take(
+    corto_pool_worker *worker)
+{
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED) - 1;
+    corto_pool_ring *ring = __atomic_load_n(&worker->ring, __ATOMIC_RELAXED);
+    corto_pool_task *task = NULL;
+    int64_t t;
+
+    __atomic_store_n(&worker->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&worker->top, __ATOMIC_RELAXED);
+
+    if (t <= b) {
+        task = __atomic_load_n(&ring->tasks[b & (ring->size - 1)],
+            __ATOMIC_RELAXED);
+        if (t == b) {
+            /* Last task, compete with stealers */
+            if (!__atomic_compare_exchange_n(&worker->top, &t, t + 1, false,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            {
+                task = NULL;
+            }
+            __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+/* Called by any thread. Sets lost if the task was taken by another thread
+ * while stealing it, in which case the deque may still contain tasks. */
+static
+corto_pool_task* corto_pool_steal(
+    corto_pool_worker *worker,
+    bool *lost)
+{
+    int64_t t = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_ACQUIRE);
+    corto_pool_task *task = NULL;
+
+    if (t < b) {
+        corto_pool_ring *ring =
+            __atomic_load_n(&worker->ring, __ATOMIC_ACQUIRE);
+        task = __atomic_load_n(&ring->tasks[t & (ring->size - 1)],
+            __ATOMIC_RELAXED);
+        if (!__atomic_compare_exchange_n(&worker->top, &t, t + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            *lost = true;
+            task = NULL;
+        }
+    }
+
+    return task;
+}
+
+static
+corto_pool_task* corto_pool_dequeue(
+    corto_pool pool)
+{
+    corto_pool_task *task = NULL;
+
+    if (!__atomic_load_n(&pool->queueCount, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+
+    corto_mutex_lock(&pool->lock);
+    if (pool->queueCount) {
+        task = pool->queue[pool->queueHead];
+        pool->queueHead = (pool->queueHead + 1) % pool->queueSize;
+        __atomic_store_n(&pool->queueCount, pool->queueCount - 1,
+            __ATOMIC_RELAXED);
+    }
+    corto_mutex_unlock(&pool->lock);
+
+    return task;
+}
+
+static
+void corto_pool_enqueue(
+    corto_pool pool,
+    corto_pool_task *task)
+{
+    corto_mutex_lock(&pool->lock);
+
+    if (pool->queueCount == pool->queueSize) {
+        uint32_t size = pool->queueSize ? pool->queueSize * 2 : 64, i;
+        corto_pool_task **queue = corto_alloc(size * sizeof(corto_pool_task*));
+        for (i = 0; i < pool->queueCount; i ++) {
+            queue[i] = pool->queue[(pool->queueHead + i) % pool->queueSize];
+        }
+        corto_dealloc(pool->queue);
+        pool->queue = queue;
+        pool->queueHead = 0;
+        pool->queueSize = size;
+    }
+
+    pool->queue[(pool->queueHead + pool->queueCount) % pool->queueSize] = task;
+    __atomic_store_n(&pool->queueCount, pool->queueCount + 1,
+        __ATOMIC_RELAXED);
+
+    corto_mutex_unlock(&pool->lock);
+}
+
+/* Find a task for the calling thread, worker is NULL if the thread isn't a
+ * worker of the pool. */
+static
+corto_pool_task* corto_pool_find(
+    corto_pool pool,
+    corto_pool_worker *worker)
+{
+    corto_pool_task *task;
+    uint32_t i, victim;
+    bool lost;
+
+    if (worker) {
+        if ((task = corto_pool_take(worker))) {
+            return task;
+        }
+    }
+
+    if ((task = corto_pool_dequeue(pool))) {
+        return task;
+    }
+
+    /* Start at a random worker, so thieves don't all rob the same worker */
+    if (worker) {
+        worker->seed = worker->seed * 1103515245 + 12345;
+        victim = (worker->seed >> 16) % pool->workerCount;
+    } else {
+        victim = __atomic_fetch_add(&pool->victim, 1, __ATOMIC_RELAXED) %
+            pool->workerCount;
+    }
+
+    do {
+        lost = false;
+        for (i = 0; i < pool->workerCount; i ++) {
+            corto_pool_worker *w =
+                &pool->workers[(victim + i) % pool->workerCount];
+            if (w != worker && (task = corto_pool_steal(w, &lost))) {
+                return task;
+            }
+        }
+    } while (lost);
+
+    return NULL;
+}
+
+static
+bool corto_pool_hasTasks(
+    corto_pool pool)
+{
+    uint32_t i;
+
+    if (__atomic_load_n(&pool->queueCount, __ATOMIC_SEQ_CST)) {
+        return true;
+    }
+
+    for (i = 0; i < pool->workerCount; i ++) {
+        corto_pool_worker *w = &pool->workers[i];
+        if (__atomic_load_n(&w->bottom, __ATOMIC_SEQ_CST) >
+            __atomic_load_n(&w->top, __ATOMIC_SEQ_CST))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Wake the waiters of a group, or the first waiter if group is NULL. Returns
+ * false if no waiter was woken. */
+static
+bool corto_pool_wakeWaiters(
+    corto_pool pool,
+    corto_pool_group *group)
+{
+    corto_pool_waiter **ptr, *waiter;
+    bool woken = false;
+
+    if (!__atomic_load_n(&pool->waiting, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+
+    corto_mutex_lock(&pool->waitLock);
+    ptr = &pool->waiters;
+    while ((waiter = *ptr)) {
+        if (group && waiter->group != group) {
+            ptr = &waiter->next;
+            continue;
+        }
+
+        *ptr = waiter->next;
+        __atomic_sub_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+        corto_sem_post(waiter->sem);
+        woken = true;
+        if (!group) {
+            break;
+        }
+    }
+    corto_mutex_unlock(&pool->waitLock);
+
+    return woken;
+}
+
+/* Sleep until the group is done, or until a task is submitted */
+static
+void corto_pool_waitSleep(
+    corto_pool pool,
+    corto_pool_group *group)
+{
+    corto_pool_waiter waiter = {corto_sem_new(0), group, NULL};
+    corto_pool_waiter **ptr;
+
+    if (!waiter.sem) {
+        return; /* The caller keeps looking for tasks */
+    }
+
+    corto_mutex_lock(&pool->waitLock);
+    waiter.next = pool->waiters;
+    pool->waiters = &waiter;
+    __atomic_add_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+    corto_mutex_unlock(&pool->waitLock);
+
+    if (!__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) ||
+        corto_pool_hasTasks(pool))
+    {
+        /* Remove the waiter, unless a thread already woke it */
+        corto_mutex_lock(&pool->waitLock);
+        for (ptr = &pool->waiters; *ptr; ptr = &(*ptr)->next) {
+            if (*ptr == &waiter) {
+                *ptr = waiter.next;
+                __atomic_sub_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+        }
+        corto_mutex_unlock(&pool->waitLock);
+    } else {
+        corto_sem_wait(waiter.sem);
+
+        /* The waking thread posts while it holds the lock, so once the lock
+         * is acquired it no longer uses the semaphore. */
+        corto_mutex_lock(&pool->waitLock);
+        corto_mutex_unlock(&pool->waitLock);
+    }
+
+    corto_sem_free(waiter.sem);
+}
+
+static
+void corto_pool_run(
+    corto_pool pool,
+    corto_pool_task *task)
+{
+    corto_pool_group *group = task->group;
+
+    task->action(task->arg);
+    corto_dealloc(task);
+
+    /* The group may no longer exist once pending is zero, so it is only used
+     * to find its waiters. */
+    if (group && !__atomic_sub_fetch(&group->pending, 1, __ATOMIC_SEQ_CST)) {
+        corto_pool_wakeWaiters(pool, group);
+    }
+}
+
+/* Wake a sleeping worker, or a waiting thread if no worker sleeps */
+static
+void corto_pool_notify(
+    corto_pool pool)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int32_t sleeping = __atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST);
+    while (sleeping) {
+        if (__atomic_compare_exchange_n(&pool->sleeping, &sleeping,
+            sleeping - 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            corto_sem_post(pool->wake);
+            return;
+        }
+    }
+
+    corto_pool_wakeWaiters(pool, NULL);
+}
+
+static
+void corto_pool_sleep(
+    corto_pool pool)
+{
+    __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+
+    if (corto_pool_hasTasks(pool) ||
+        __atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST))
+    {
+        int32_t sleeping = __atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST);
+        while (sleeping) {
+            if (__atomic_compare_exchange_n(&pool->sleeping, &sleeping,
+                sleeping - 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            {
+                return;
+            }
+        }
+        /* A submitter undid the increment, and posts the semaphore */
+    }
+
+    corto_sem_wait(pool->wake);
+}
+
+static
+void* corto_pool_workerRun(
+    void *arg)
+{
+    corto_pool_worker *worker = arg;
+    corto_pool pool = worker->pool;
+    uint32_t idle = 0;
+
+    corto_tls_set(CORTO_KEY_POOL_WORKER, worker);
+
+    for (;;) {
+        corto_pool_task *task = corto_pool_find(pool, worker);
+        if (task) {
+            corto_pool_run(pool, task);
+            idle = 0;
+        } else if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        } else if (++ idle >= CORTO_POOL_SPIN) {
+            corto_pool_sleep(pool);
+            idle = 0;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t corto_pool_cpuCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+/* Stop and join the first count workers of the pool */
+static
+void corto_pool_stop(
+    corto_pool pool,
+    uint32_t count)
+{
+    uint32_t i;
+
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+
+    /* Workers check stop before they sleep, so one post per worker wakes up
+     * every worker that is already sleeping. */
+    for (i = 0; i < count; i ++) {
+        corto_sem_post(pool->wake);
+    }
+
+    for (i = 0; i < count; i ++) {
+        corto_thread_join(pool->workers[i].thread, NULL);
+    }
+}
+
+static
+void corto_pool_dealloc(
+    corto_pool pool)
+{
+    uint32_t i;
+
+    for (i = 0; i < pool->workerCount; i ++) {
+        corto_pool_ring *ring = pool->workers[i].ring, *prev;
+        for (; ring; ring = prev) {
+            prev = ring->prev;
+            corto_dealloc(ring);
+        }
+    }
+
+    corto_sem_free(pool->wake);
+    corto_mutex_free(&pool->waitLock);
+    corto_mutex_free(&pool->lock);
+    corto_dealloc(pool->queue);
+    corto_dealloc(pool->workers);
+    corto_dealloc(pool);
+}
+
+corto_pool corto_pool_new(
+    uint32_t workers)
+{
+    corto_pool pool = corto_calloc(sizeof(struct corto_pool_s));
+    uint32_t i;
+
+    if (!workers) {
+        workers = corto_pool_cpuCount();
+    }
+
+    if (corto_mutex_new(&pool->lock)) {
+        goto error;
+    }
+
+    if (!(pool->wake = corto_sem_new(0))) {
+        corto_throw("failed to create semaphore for thread pool");
+        goto error_lock;
+    }
+
+    if (corto_mutex_new(&pool->waitLock)) {
+        goto error_wake;
+    }
+
+    pool->workerCount = workers;
+    pool->workers = corto_calloc(workers * sizeof(corto_pool_worker));
+
+    for (i = 0; i < workers; i ++) {
+        corto_pool_worker *worker = &pool->workers[i];
+        worker->ring = corto_pool_ringNew(CORTO_POOL_DEQUE_SIZE);
+        worker->pool = pool;
+        worker->seed = i + 1;
+    }
+
+    /* Start workers after all deques exist, as workers steal from each other */
+    for (i = 0; i < workers; i ++) {
+        pool->workers[i].thread =
+            corto_thread_new(corto_pool_workerRun, &pool->workers[i]);
+        if (!pool->workers[i].thread) {
+            corto_throw("failed to start worker %u of thread pool", i);
+            corto_pool_stop(pool, i);
+            corto_pool_dealloc(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+error_wake:
+    corto_sem_free(pool->wake);
+error_lock:
+    corto_mutex_free(&pool->lock);
+error:
+    corto_dealloc(pool);
+    return NULL;
+}
+
+void corto_pool_free(
+    corto_pool pool)
+{
+    corto_pool_stop(pool, pool->workerCount);
+    corto_pool_dealloc(pool);
+}
+
+/* Number of workers of the shared pool, from CORTO_POOL_WORKERS if it is a
+ * number between 1 and CORTO_POOL_MAX_WORKERS. */
+static
+uint32_t corto_pool_defaultWorkers(void) {
+    char *workers = corto_getenv("CORTO_POOL_WORKERS"), *end;
+    long count;
+
+    if (!workers) {
+        return corto_pool_cpuCount();
+    }
+
+    errno = 0;
+    count = strtol(workers, &end, 10);
+    if (errno || end == workers || *end || count < 1 ||
+        count > CORTO_POOL_MAX_WORKERS)
+    {
+        corto_warning(
+            "invalid value '%s' for CORTO_POOL_WORKERS, expected number "
+            "between 1 and %d", workers, CORTO_POOL_MAX_WORKERS);
+        return corto_pool_cpuCount();
+    }
+
+    return count;
+}
+
+corto_pool corto_pool_default(void) {
+    corto_pool pool = __atomic_load_n(&corto_pool_shared, __ATOMIC_ACQUIRE);
+
+    if (!pool) {
+        corto_mutex_lock(&corto_pool_lock);
+        if (!(pool = corto_pool_shared)) {
+            pool = corto_pool_new(corto_pool_defaultWorkers());
+            __atomic_store_n(&corto_pool_shared, pool, __ATOMIC_RELEASE);
+        }
+        corto_mutex_unlock(&corto_pool_lock);
+    }
+
+    return pool;
+}
+
+int16_t corto_pool_submit(
+    corto_pool pool,
+    corto_pool_group *group,
+    corto_pool_cb action,
+    void *arg)
+{
+    corto_pool_worker *worker = corto_tls_get(CORTO_KEY_POOL_WORKER);
+    corto_pool_task *task;
+
+    if (__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+        corto_throw("cannot submit task to pool that is being freed");
+        goto error;
+    }
+
+    task = corto_alloc(sizeof(corto_pool_task));
+    task->action = action;
+    task->arg = arg;
+    task->group = group;
+
+    if (group) {
+        __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    }
+
+    if (worker && worker->pool == pool) {
+        corto_pool_push(worker, task);
+    } else {
+        corto_pool_enqueue(pool, task);
+    }
+
+    corto_pool_notify(pool);
+
+    return 0;
+error:
+    return -1;
+}
+
+void corto_pool_wait(
+    corto_pool pool,
+    corto_pool_group *group)
+{
+    corto_pool_worker *worker = corto_tls_get(CORTO_KEY_POOL_WORKER);
+    uint32_t idle = 0;
+
+    if (worker && worker->pool != pool) {
+        worker = NULL;
+    }
+
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) {
+        corto_pool_task *task = corto_pool_find(pool, worker);
+        if (task) {
+            corto_pool_run(pool, task);
+            idle = 0;
+        } else if (++ idle >= CORTO_POOL_SPIN) {
+            /* Remaining tasks are running on other threads */
+            corto_pool_waitSleep(pool, group);
+            idle = 0;
+        }
+    }
+}
+
+uint32_t corto_pool_workers(
+    corto_pool pool)
+{
+    return pool->workerCount;
+}
+
+void corto_pool_deinit(void) {
+    if (corto_pool_shared) {
+        corto_pool_free(corto_pool_shared);
+        corto_pool_shared = NULL;
+    }
+}
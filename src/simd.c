@@ -0,0 +1,42 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "simd.h"
+
+static int8_t corto_simd_avx2 = -1;
+
+bool corto_simd_hasAvx2(void) {
+    int8_t result = __atomic_load_n(&corto_simd_avx2, __ATOMIC_RELAXED);
+
+    if (result == -1) {
+#ifdef CORTO_SIMD_AVX2
+        __builtin_cpu_init();
+        result = __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+        result = 0;
+#endif
+        /* Racing threads compute the same value, so the order of the stores
+         * doesn't matter, but they must be atomic. */
+        __atomic_store_n(&corto_simd_avx2, result, __ATOMIC_RELAXED);
+    }
+
+    return result;
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CORTO__SIMD_H_
+#define CORTO__SIMD_H_
+
+#include <corto/platform.h>
+
+/* SSE2 kernels are used whenever the compiler targets SSE2 (always the case on
+ * x86_64). AVX2 kernels are compiled with a function-level target attribute and
+ * selected at runtime, so binaries keep running on CPUs without AVX2. Define
+ * CORTO_NO_SIMD to only build the scalar implementations. */
+
+/* Kernels read past the end of strings (see corto_simd_pageSafe), which is safe
+ * but is reported by AddressSanitizer. */
+#if defined(__SANITIZE_ADDRESS__)
+#define CORTO_NO_SIMD
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CORTO_NO_SIMD
+#endif
+#endif
+
+#ifndef CORTO_NO_SIMD
+#ifdef __SSE2__
+#define CORTO_SIMD_SSE2
+#include <emmintrin.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CORTO_SIMD_AVX2
+#define CORTO_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+#endif
+
+/* Vector loads may read past the end of a string, as long as they don't cross
+ * a page boundary (the smallest unit of memory protection). Kernels only use
+ * unaligned loads when this macro says the load stays within the page. */
+#define CORTO_SIMD_PAGE_SIZE (4096)
+#define corto_simd_pageSafe(ptr, n) \
+    ((((uintptr_t)(ptr)) & (CORTO_SIMD_PAGE_SIZE - 1)) <= (CORTO_SIMD_PAGE_SIZE - (n)))
+
+/* ASCII case folding, equivalent to tolower/toupper in the C locale */
+#define corto_simd_lower(ch) \
+    ((char)(((ch) >= 'A' && (ch) <= 'Z') ? ((ch) | 0x20) : (ch)))
+#define corto_simd_upper(ch) \
+    ((char)(((ch) >= 'a' && (ch) <= 'z') ? ((ch) & ~0x20) : (ch)))
+
+/* Returns true when the CPU supports AVX2. Result is cached after first call. */
+bool corto_simd_hasAvx2(void);
+
+/* Returns index of first of n characters where str1 and str2 differ insensitive
+ * of case, or where str1 has a null character. Returns n if there is none. */
+size_t corto_simd_strimismatch(
+    const char *str1,
+    const char *str2,
+    size_t n);
+
+/* Returns number of characters before the first null character, delimiter or
+ * character that needs to be escaped by chresc. */
+size_t corto_simd_strescspan(
+    const char *str,
+    char delimiter);
+
+#endif
@@ -19,53 +19,221 @@
  * THE SOFTWARE.
  */
 
-#include <corto/platform.h>
-
-int stricmp(const char *str1, const char *str2) {
-    const char *ptr1, *ptr2;
+#include "simd.h"
+
+/* -- Case-insensitive comparison kernels --
+ * All comparison functions are built on a single kernel which returns the index
+ * of the first character where two strings differ (ignoring case), or where the
+ * first string ends. The kernel is selected on first use, based on the
+ * capabilities of the CPU. */
+
+typedef size_t (*corto_strimismatch_cb)(
+    const char *str1,
+    const char *str2,
+    size_t n);
+
+static
+size_t corto_strimismatch_scalar(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    size_t i;
     char ch1, ch2;
-    ptr1 = str1;
-    ptr2 = str2;
 
-    while((ch1 = *ptr1) && (ch2 = *ptr2)) {
-        if (ch1 == ch2) {
-            ptr1++; ptr2++;
-            continue;
+    for (i = 0; i < n; i ++) {
+        ch1 = str1[i];
+        ch2 = str2[i];
+        if (!ch1) {
+            break;
         }
-        if (ch1 < 97) ch1 = tolower(ch1);
-        if (ch2 < 97) ch2 = tolower(ch2);
         if (ch1 != ch2) {
-            return ch1 - ch2;
+            if (corto_simd_lower(ch1) != corto_simd_lower(ch2)) {
+                break;
+            }
         }
-        ptr1++;
-        ptr2++;
     }
 
-    return tolower(*ptr1) - tolower(*ptr2);
+    return i;
 }
 
-int strnicmp(const char *str1, int length, const char *str2) {
-    const char *ptr1, *ptr2;
-    char ch1, ch2;
-    ptr1 = str1;
-    ptr2 = str2;
+#ifdef CORTO_SIMD_SSE2
+static inline
+__m128i corto_simd_lower_sse2(
+    __m128i v)
+{
+    __m128i upper = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
 
-    while((ch1 = *ptr1) && (ch2 = *ptr2)) {
-        if (ptr1 - str1 >= (length - 1)) break;
-        if (ch1 == ch2) {
-            ptr1++; ptr2++;
-            continue;
+static inline
+__m128i corto_simd_upper_sse2(
+    __m128i v)
+{
+    __m128i lower = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    return _mm_andnot_si128(_mm_and_si128(lower, _mm_set1_epi8(0x20)), v);
+}
+
+static
+size_t corto_strimismatch_sse2(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    size_t i = 0;
+
+    while ((n - i) >= 16 &&
+        corto_simd_pageSafe(str1 + i, 16) &&
+        corto_simd_pageSafe(str2 + i, 16))
+    {
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(str1 + i));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(str2 + i));
+        __m128i eq = _mm_cmpeq_epi8(
+            corto_simd_lower_sse2(v1), corto_simd_lower_sse2(v2));
+        __m128i nul = _mm_cmpeq_epi8(v1, _mm_setzero_si128());
+        int mask = ~_mm_movemask_epi8(_mm_andnot_si128(nul, eq)) & 0xFFFF;
+        if (mask) {
+            return i + __builtin_ctz(mask);
         }
-        if (ch1 < 97) ch1 = tolower(ch1);
-        if (ch2 < 97) ch2 = tolower(ch2);
-        if (ch1 != ch2) {
-            return ch1 - ch2;
+        i += 16;
+    }
+
+    return i + corto_strimismatch_scalar(str1 + i, str2 + i, n - i);
+}
+#endif
+
+#ifdef CORTO_SIMD_AVX2
+static inline CORTO_SIMD_TARGET_AVX2
+__m256i corto_simd_lower_avx2(
+    __m256i v)
+{
+    __m256i upper = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+static inline CORTO_SIMD_TARGET_AVX2
+__m256i corto_simd_upper_avx2(
+    __m256i v)
+{
+    __m256i lower = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    return _mm256_andnot_si256(
+        _mm256_and_si256(lower, _mm256_set1_epi8(0x20)), v);
+}
+
+static CORTO_SIMD_TARGET_AVX2
+size_t corto_strimismatch_avx2(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    size_t i = 0;
+
+    while ((n - i) >= 32 &&
+        corto_simd_pageSafe(str1 + i, 32) &&
+        corto_simd_pageSafe(str2 + i, 32))
+    {
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(str1 + i));
+        __m256i v2 = _mm256_loadu_si256((const __m256i*)(str2 + i));
+        __m256i eq = _mm256_cmpeq_epi8(
+            corto_simd_lower_avx2(v1), corto_simd_lower_avx2(v2));
+        __m256i nul = _mm256_cmpeq_epi8(v1, _mm256_setzero_si256());
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(
+            _mm256_andnot_si256(nul, eq));
+        if (mask) {
+            return i + __builtin_ctz(mask);
         }
-        ptr1++;
-        ptr2++;
+        i += 32;
+    }
+
+    /* Clear upper halves of ymm registers before running SSE code */
+    _mm256_zeroupper();
+    return i + corto_strimismatch_sse2(str1 + i, str2 + i, n - i);
+}
+#endif
+
+static
+size_t corto_strimismatch_resolve(
+    const char *str1,
+    const char *str2,
+    size_t n);
+
+static corto_strimismatch_cb corto_strimismatch = corto_strimismatch_resolve;
+
+/* Select kernel on first invocation. Threads may select the kernel at the same
+ * time, so the pointer is accessed atomically. They select the same kernel, so
+ * the order doesn't matter. */
+static
+size_t corto_strimismatch_resolve(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    corto_strimismatch_cb kernel = corto_strimismatch_scalar;
+#ifdef CORTO_SIMD_SSE2
+    kernel = corto_strimismatch_sse2;
+#endif
+#ifdef CORTO_SIMD_AVX2
+    if (corto_simd_hasAvx2()) {
+        kernel = corto_strimismatch_avx2;
     }
+#endif
+    __atomic_store_n(&corto_strimismatch, kernel, __ATOMIC_RELAXED);
+    return kernel(str1, str2, n);
+}
+
+size_t corto_simd_strimismatch(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    corto_strimismatch_cb kernel =
+        __atomic_load_n(&corto_strimismatch, __ATOMIC_RELAXED);
+    return kernel(str1, str2, n);
+}
+
+/* Compute result in the same way as the original byte-by-byte loop: when both
+ * characters are valid the folded characters are subtracted, otherwise the
+ * result of tolower is used. */
+static inline
+int corto_strichardiff(
+    char ch1,
+    char ch2,
+    bool inLoop)
+{
+    if (inLoop && ch1 && ch2) {
+        return (char)corto_simd_lower(ch1) - (char)corto_simd_lower(ch2);
+    } else {
+        return tolower(ch1) - tolower(ch2);
+    }
+}
+
+int stricmp(const char *str1, const char *str2) {
+    size_t i = corto_simd_strimismatch(str1, str2, SIZE_MAX);
+    return corto_strichardiff(str1[i], str2[i], true);
+}
+
+int strnicmp(const char *str1, int length, const char *str2) {
+    /* The character at length - 1 is compared after the loop, so only the
+     * first length - 1 characters need to be scanned for a mismatch. */
+    size_t n = length > 1 ? (size_t)(length - 1) : 0;
+    size_t i = corto_simd_strimismatch(str1, str2, n);
+    return corto_strichardiff(str1[i], str2[i], i < n);
+}
 
-    return tolower(*ptr1) - tolower(*ptr2);
+int strpicmp(const char *str, const char *prefix) {
+    size_t i = corto_simd_strimismatch(prefix, str, SIZE_MAX);
+    if (!prefix[i]) {
+        return 0;
+    }
+    return corto_strichardiff(str[i], prefix[i], true);
 }
 
 int tokicmp(char ** const str1, const char *str2, char sep) {
@@ -131,49 +299,76 @@ char *strappend(char *src, const char *fmt, ...) {
     return src;
 }
 
+/* -- Escaping --
+ * Escape sequences are looked up in a table. Strings are escaped by scanning
+ * for the next byte that needs attention (an escapable character, the
+ * delimiter or the terminating null character) and copying the run of bytes
+ * before it in one go. */
+
+static const char corto_stresc_table[256] = {
+    ['\a'] = 'a', ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n',
+    ['\r'] = 'r', ['\t'] = 't', ['\v'] = 'v', ['\\'] = '\\'
+};
+
+static const char corto_strunesc_table[256] = {
+    ['a'] = '\a', ['b'] = '\b', ['f'] = '\f', ['n'] = '\n',
+    ['r'] = '\r', ['t'] = '\t', ['v'] = '\v'
+};
+
+#define corto_stresc_special(ch, delimiter) \
+    (!(ch) || corto_stresc_table[(uint8_t)(ch)] || (ch) == (delimiter))
+
+size_t corto_simd_strescspan(
+    const char *str,
+    char delimiter)
+{
+    size_t i = 0;
+
+#ifdef CORTO_SIMD_SSE2
+    /* Escapable control characters are the contiguous range '\a'..'\r' */
+    const __m128i first = _mm_set1_epi8('\a');
+    const __m128i range = _mm_set1_epi8('\r' - '\a');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i delim = _mm_set1_epi8(delimiter);
+
+    while (true) {
+        if (corto_simd_pageSafe(str + i, 16)) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+            __m128i t = _mm_sub_epi8(v, first);
+            __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(t, range), t);
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, backslash));
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, delim));
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+            int mask = _mm_movemask_epi8(m);
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+            i += 16;
+        } else {
+            /* Step over page boundary one byte at a time */
+            if (corto_stresc_special(str[i], delimiter)) {
+                return i;
+            }
+            i ++;
+        }
+    }
+#else
+    while (!corto_stresc_special(str[i], delimiter)) {
+        i ++;
+    }
+    return i;
+#endif
+}
+
 char *chresc(char *out, char in, char delimiter) {
     char *bptr = out;
-    switch(in) {
-    case '\a':
-        *bptr++ = '\\';
-        *bptr = 'a';
-        break;
-    case '\b':
-        *bptr++ = '\\';
-        *bptr = 'b';
-        break;
-    case '\f':
-        *bptr++ = '\\';
-        *bptr = 'f';
-        break;
-    case '\n':
-        *bptr++ = '\\';
-        *bptr = 'n';
-        break;
-    case '\r':
-        *bptr++ = '\\';
-        *bptr = 'r';
-        break;
-    case '\t':
-        *bptr++ = '\\';
-        *bptr = 't';
-        break;
-    case '\v':
-        *bptr++ = '\\';
-        *bptr = 'v';
-        break;
-    case '\\':
+    char esc = corto_stresc_table[(uint8_t)in];
+
+    if (esc || (in == delimiter)) {
         *bptr++ = '\\';
-        *bptr = '\\';
-        break;
-    default:
-        if (in == delimiter) {
-            *bptr++ = '\\';
-            *bptr = delimiter;
-        } else {
-            *bptr = in;
-        }
-        break;
+        *bptr = esc ? esc : delimiter;
+    } else {
+        *bptr = in;
     }
 
     *(++bptr) = '\0';
@@ -183,25 +378,92 @@ char *chresc(char *out, char in, char delimiter) {
 
 size_t stresc(char *out, size_t n, const char *in) {
     const char *ptr = in;
-    char ch, *bptr = out, buff[3];
+    char *bptr = out;
     size_t written = 0;
-    while ((ch = *ptr++)) {
-        if ((written += (chresc(buff, ch, '"') - buff)) <= n) {
-            *bptr++ = buff[0];
-            if ((ch = buff[1])) {
-                *bptr = ch;
-                bptr++;
-            }
+
+    while (true) {
+        size_t run = corto_simd_strescspan(ptr, '"');
+
+        /* Copy as many characters of the run as fit */
+        if (out && written < n) {
+            size_t fit = (n - written) < run ? (n - written) : run;
+            memcpy(bptr, ptr, fit);
+            bptr += fit;
         }
+        written += run;
+        ptr += run;
+
+        if (!*ptr) {
+            break;
+        }
+
+        /* Escape sequences are never truncated */
+        if ((written += 2) <= n && out) {
+            char esc = corto_stresc_table[(uint8_t)*ptr];
+            *(bptr++) = '\\';
+            *(bptr++) = esc ? esc : *ptr;
+        }
+        ptr ++;
+    }
+
+    /* Pad remainder of output, which counts as written */
+    if (out && written < n) {
+        memset(bptr, 0, n - written);
+        written = n;
     }
 
-    if (bptr) {
-        while (written < n) {
-            *bptr = '\0';
-            bptr++;
-            written++;
+    return written;
+}
+
+const char *chrunesc(char *out, const char *in) {
+    const char *ptr = in;
+
+    if (ptr[0] == '\\' && ptr[1]) {
+        char esc = corto_strunesc_table[(uint8_t)ptr[1]];
+        *out = esc ? esc : ptr[1];
+        ptr += 2;
+    } else if (ptr[0]) {
+        *out = *ptr;
+        ptr ++;
+    } else {
+        *out = '\0';
+    }
+
+    return ptr;
+}
+
+size_t strunesc(char *out, size_t n, const char *in) {
+    const char *ptr = in, *esc;
+    char *bptr = out;
+    size_t written = 0;
+
+    while (true) {
+        esc = strchr(ptr, '\\');
+        size_t run = esc ? (size_t)(esc - ptr) : strlen(ptr);
+
+        if (out && written < n) {
+            size_t fit = (n - written) < run ? (n - written) : run;
+            memcpy(bptr, ptr, fit);
+            bptr += fit;
+        }
+        written += run;
+        ptr += run;
+
+        if (!*ptr) {
+            break;
         }
+
+        char ch;
+        ptr = chrunesc(&ch, ptr);
+        if (++ written <= n && out) {
+            *(bptr++) = ch;
+        }
+    }
+
+    if (out && written < n) {
+        memset(bptr, 0, n - written);
     }
+
     return written;
 }
 
@@ -216,6 +478,39 @@ void strset(char **out, const char *str) {
     }
 }
 
+/* FNV-1a, which is fast for the short strings typically found in ids */
+#define CORTO_FNV_OFFSET (2166136261u)
+#define CORTO_FNV_PRIME (16777619u)
+
+uint32_t strhash(const char *str) {
+    uint32_t hash = CORTO_FNV_OFFSET;
+    const char *ptr;
+    char ch;
+    for (ptr = str; (ch = *ptr); ptr ++) {
+        hash = (hash ^ (uint8_t)ch) * CORTO_FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t strihash(const char *str) {
+    uint32_t hash = CORTO_FNV_OFFSET;
+    const char *ptr;
+    char ch;
+    for (ptr = str; (ch = *ptr); ptr ++) {
+        hash = (hash ^ (uint8_t)corto_simd_lower(ch)) * CORTO_FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t corto_strview_ihash(corto_strview str) {
+    uint32_t hash = CORTO_FNV_OFFSET;
+    size_t i;
+    for (i = 0; i < str.len; i ++) {
+        hash = (hash ^ (uint8_t)corto_simd_lower(str.ptr[i])) * CORTO_FNV_PRIME;
+    }
+    return hash;
+}
+
 /* strdup is not a standard C function, so provide own implementation. */
 char* corto_strdup(const char* str) {
     char *result = corto_alloc(strlen(str) + 1);
@@ -274,12 +569,69 @@ char* strarg(const char *fmt, ...) {
     return result;
 }
 
+/* Convert characters in string in blocks of 16 (SSE2) or 32 (AVX2) bytes, and
+ * return the location from where the remainder should be converted */
+#ifdef CORTO_SIMD_SSE2
+static
+char* corto_strconvert_sse2(
+    char *ptr,
+    bool upper)
+{
+    while (corto_simd_pageSafe(ptr, 16)) {
+        __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()))) {
+            break;
+        }
+        v = upper ? corto_simd_upper_sse2(v) : corto_simd_lower_sse2(v);
+        _mm_storeu_si128((__m128i*)ptr, v);
+        ptr += 16;
+    }
+    return ptr;
+}
+#endif
+
+#ifdef CORTO_SIMD_AVX2
+static CORTO_SIMD_TARGET_AVX2
+char* corto_strconvert_avx2(
+    char *ptr,
+    bool upper)
+{
+    while (corto_simd_pageSafe(ptr, 32)) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)ptr);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()))) {
+            break;
+        }
+        v = upper ? corto_simd_upper_avx2(v) : corto_simd_lower_avx2(v);
+        _mm256_storeu_si256((__m256i*)ptr, v);
+        ptr += 32;
+    }
+    _mm256_zeroupper();
+    return corto_strconvert_sse2(ptr, upper);
+}
+#endif
+
+static
+char* corto_strconvert(
+    char *ptr,
+    bool upper)
+{
+#ifdef CORTO_SIMD_AVX2
+    if (corto_simd_hasAvx2()) {
+        return corto_strconvert_avx2(ptr, upper);
+    }
+#endif
+#ifdef CORTO_SIMD_SSE2
+    ptr = corto_strconvert_sse2(ptr, upper);
+#endif
+    return ptr;
+}
+
 /* Convert characters in string to uppercase */
 char* strupper(char *str) {
     char *ptr, ch;
-    ptr = str;
+    ptr = corto_strconvert(str, true);
     while ((ch = *ptr)) {
-        if (ch >= 97) *ptr = toupper(ch);
+        *ptr = corto_simd_upper(ch);
         ptr++;
     }
     return str;
@@ -288,55 +640,247 @@ char* strupper(char *str) {
 /* Convert characters in string to lowercase */
 char* strlower(char *str) {
     char *ptr, ch;
-    ptr = str;
+    ptr = corto_strconvert(str, false);
     while ((ch = *ptr)) {
-        if (ch < 97) *ptr = tolower(ch);
+        *ptr = corto_simd_lower(ch);
         ptr++;
     }
     return str;
 }
 
-// You must free the result if result is non-NULL.
-char* strreplace(char *orig, char *rep, char *with) {
-    char *result; // the return string
-    char *ins;    // the next insert point
-    char *tmp;    // varies
-    int len_rep;  // length of rep
-    int len_with; // length of with
-    int len_front; // distance between rep and end of last rep
-    int count;    // number of replacements
-
-    if (!orig)
-        return NULL;
-    if (!rep)
-        rep = "";
-    len_rep = strlen(rep);
-    if (!with)
-        with = "";
-    len_with = strlen(with);
-
-    ins = orig;
-    for (count = 0; (tmp = strstr(ins, rep)); ++count) {
-        ins = tmp + len_rep;
-    }
-
-    // first time through the loop, all the variable are set correctly
-    // from here on,
-    //    tmp points to the end of the result string
-    //    ins points to the next occurrence of rep in orig
-    //    orig points to the remainder of orig after "end of rep"
-    tmp = result = malloc(strlen(orig) + (len_with - len_rep) * count + 1);
-
-    if (!result)
+/* -- Multi-pattern replace --
+ * Patterns are stored in a byte trie, where the children of the root are
+ * indexed by character. At each position of the input the trie is walked for
+ * as long as characters match, and the last pattern seen is the longest match.
+ * Characters that do not start a pattern are skipped without entering the
+ * trie. */
+
+#define CORTO_STRREPLACE_STACK_NODES (256)
+#define CORTO_STRREPLACE_STACK_PAIRS (16)
+
+typedef struct corto_strreplace_node {
+    int32_t child;      /* First child, -1 if none */
+    int32_t sibling;    /* Next node with same parent, -1 if none */
+    int32_t pattern;    /* Pattern that ends in this node, -1 if none */
+    char ch;
+} corto_strreplace_node;
+
+typedef struct corto_strreplace_index {
+    const corto_strreplace_pair *pairs;
+    int32_t root[256];
+    corto_strreplace_node *nodes;
+    int32_t nodeCount;
+    size_t *withLen;
+    char single;        /* Set if all patterns start with the same character */
+} corto_strreplace_index;
+
+/* Find or add child of node (-1 for root) */
+static
+int32_t corto_strreplace_child(
+    corto_strreplace_index *idx,
+    int32_t node,
+    char ch)
+{
+    int32_t *link = (node == -1)
+        ? &idx->root[(uint8_t)ch]
+        : &idx->nodes[node].child;
+
+    if (node != -1) {
+        while (*link != -1 && idx->nodes[*link].ch != ch) {
+            link = &idx->nodes[*link].sibling;
+        }
+    }
+
+    if (*link == -1) {
+        int32_t result = idx->nodeCount ++;
+        idx->nodes[result].child = -1;
+        idx->nodes[result].sibling = -1;
+        idx->nodes[result].pattern = -1;
+        idx->nodes[result].ch = ch;
+        *link = result;
+    }
+
+    return *link;
+}
+
+static
+void corto_strreplace_indexInit(
+    corto_strreplace_index *idx,
+    const corto_strreplace_pair *pairs,
+    int32_t count)
+{
+    int32_t i, firstCount = 0;
+
+    idx->pairs = pairs;
+    idx->nodeCount = 0;
+    idx->single = '\0';
+    memset(idx->root, -1, sizeof(idx->root));
+
+    for (i = 0; i < count; i ++) {
+        const char *ptr = pairs[i].pattern;
+        int32_t node = -1;
+
+        idx->withLen[i] = pairs[i].with ? strlen(pairs[i].with) : 0;
+
+        /* Empty patterns never match */
+        if (!ptr || !ptr[0]) {
+            continue;
+        }
+
+        if (idx->root[(uint8_t)ptr[0]] == -1) {
+            idx->single = firstCount ? '\0' : ptr[0];
+            firstCount ++;
+        }
+
+        for (; *ptr; ptr ++) {
+            node = corto_strreplace_child(idx, node, *ptr);
+        }
+
+        /* When a pattern occurs twice, the first one wins */
+        if (idx->nodes[node].pattern == -1) {
+            idx->nodes[node].pattern = i;
+        }
+    }
+}
+
+/* Returns longest pattern matching at str, or -1 if none */
+static
+int32_t corto_strreplace_match(
+    const corto_strreplace_index *idx,
+    const char *str,
+    size_t *len_out)
+{
+    int32_t node = idx->root[(uint8_t)str[0]], result = -1;
+    const char *ptr = str;
+
+    while (node != -1) {
+        const corto_strreplace_node *n = &idx->nodes[node];
+        ptr ++;
+        if (n->pattern != -1) {
+            result = n->pattern;
+            *len_out = ptr - str;
+        }
+        if (!*ptr) {
+            break;
+        }
+        for (node = n->child;
+             node != -1 && idx->nodes[node].ch != *ptr;
+             node = idx->nodes[node].sibling)
+            ;
+    }
+
+    return result;
+}
+
+/* Scan string for patterns. When out is NULL only the length of the result is
+ * computed, so the same scan is used for sizing and for writing. */
+static
+size_t corto_strreplace_scan(
+    const corto_strreplace_index *idx,
+    const char *str,
+    char *out)
+{
+    const char *ptr = str;
+    size_t len = 0;
+
+    while (true) {
+        const char *start = ptr;
+
+        /* Skip to next character that starts a pattern */
+        if (idx->single) {
+            ptr = strchr(ptr, idx->single);
+            if (!ptr) {
+                ptr = start + strlen(start);
+            }
+        } else {
+            while (*ptr && idx->root[(uint8_t)*ptr] == -1) {
+                ptr ++;
+            }
+        }
+
+        if (out) {
+            memcpy(&out[len], start, ptr - start);
+        }
+        len += ptr - start;
+
+        if (!*ptr) {
+            break;
+        }
+
+        size_t patternLen = 0;
+        int32_t i = corto_strreplace_match(idx, ptr, &patternLen);
+        if (i != -1) {
+            if (out && idx->withLen[i]) {
+                memcpy(&out[len], idx->pairs[i].with, idx->withLen[i]);
+            }
+            len += idx->withLen[i];
+            ptr += patternLen;
+        } else {
+            if (out) {
+                out[len] = *ptr;
+            }
+            len ++;
+            ptr ++;
+        }
+    }
+
+    return len;
+}
+
+char* strreplacem(
+    const char *str,
+    const corto_strreplace_pair *pairs,
+    int32_t count)
+{
+    corto_strreplace_node nodes[CORTO_STRREPLACE_STACK_NODES];
+    size_t withLen[CORTO_STRREPLACE_STACK_PAIRS];
+    corto_strreplace_index idx;
+    size_t nodeCount = 0;
+    int32_t i;
+    char *result;
+
+    if (!str) {
         return NULL;
+    }
+
+    if (count < 0) {
+        count = 0;
+    }
+
+    for (i = 0; i < count; i ++) {
+        if (pairs[i].pattern) {
+            nodeCount += strlen(pairs[i].pattern);
+        }
+    }
+
+    idx.nodes = (nodeCount <= CORTO_STRREPLACE_STACK_NODES)
+        ? nodes
+        : corto_alloc(nodeCount * sizeof(corto_strreplace_node));
+    idx.withLen = (count <= CORTO_STRREPLACE_STACK_PAIRS)
+        ? withLen
+        : corto_alloc(count * sizeof(size_t));
+
+    corto_strreplace_indexInit(&idx, pairs, count);
+
+    size_t len = corto_strreplace_scan(&idx, str, NULL);
+    result = corto_alloc(len + 1);
+    if (result) {
+        corto_strreplace_scan(&idx, str, result);
+        result[len] = '\0';
+    }
 
-    while (count--) {
-        ins = strstr(orig, rep);
-        len_front = ins - orig;
-        tmp = strncpy(tmp, orig, len_front) + len_front;
-        tmp = strcpy(tmp, with) + len_with;
-        orig += len_front + len_rep; // move to next "end of rep"
+    if (idx.nodes != nodes) {
+        corto_dealloc(idx.nodes);
     }
-    strcpy(tmp, orig);
+    if (idx.withLen != withLen) {
+        corto_dealloc(idx.withLen);
+    }
+
     return result;
 }
+
+// You must free the result if result is non-NULL.
+char* strreplace(char *orig, char *rep, char *with) {
+    corto_strreplace_pair pair = {rep, with};
+    return strreplacem(orig, &pair, 1);
+}
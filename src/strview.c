@@ -0,0 +1,201 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "simd.h"
+
+corto_strview corto_strview_from(
+    const char *str)
+{
+    if (!str) {
+        return CORTO_STRVIEW_EMPTY;
+    }
+    return CORTO_STRVIEW(str, strlen(str));
+}
+
+bool corto_strview_next(
+    corto_strview *str,
+    char sep,
+    corto_strview *elem_out)
+{
+    if (!str->ptr) {
+        return false;
+    }
+
+    const char *end = memchr(str->ptr, sep, str->len);
+    if (end) {
+        *elem_out = CORTO_STRVIEW(str->ptr, end - str->ptr);
+        str->len -= end - str->ptr + 1;
+        str->ptr = end + 1;
+    } else {
+        /* Last element. Invalidate view so next call returns false */
+        *elem_out = *str;
+        str->ptr = NULL;
+        str->len = 0;
+    }
+
+    return true;
+}
+
+corto_strview corto_strview_trim(
+    corto_strview str)
+{
+    while (str.len && isspace((unsigned char)str.ptr[0])) {
+        str.ptr ++;
+        str.len --;
+    }
+    while (str.len && isspace((unsigned char)str.ptr[str.len - 1])) {
+        str.len --;
+    }
+    return str;
+}
+
+corto_strview corto_strview_slice(
+    corto_strview str,
+    size_t start,
+    size_t len)
+{
+    if (start > str.len) {
+        start = str.len;
+    }
+    if (len > str.len - start) {
+        len = str.len - start;
+    }
+    return CORTO_STRVIEW(str.ptr + start, len);
+}
+
+ptrdiff_t corto_strview_find(
+    corto_strview str,
+    char ch)
+{
+    const char *ptr = str.len ? memchr(str.ptr, ch, str.len) : NULL;
+    return ptr ? ptr - str.ptr : -1;
+}
+
+ptrdiff_t corto_strview_findstr(
+    corto_strview str,
+    corto_strview needle)
+{
+    if (!needle.len) {
+        return 0;
+    }
+
+    const char *ptr = str.ptr, *end = str.ptr + str.len;
+    while ((size_t)(end - ptr) >= needle.len) {
+        ptr = memchr(ptr, needle.ptr[0], (end - ptr) - needle.len + 1);
+        if (!ptr) {
+            break;
+        }
+        if (!memcmp(ptr + 1, needle.ptr + 1, needle.len - 1)) {
+            return ptr - str.ptr;
+        }
+        ptr ++;
+    }
+
+    return -1;
+}
+
+bool corto_strview_equals(
+    corto_strview str1,
+    corto_strview str2)
+{
+    return (str1.len == str2.len) && !memcmp(str1.ptr, str2.ptr, str1.len);
+}
+
+/* Compare n characters insensitive of case. The mismatch kernel stops at null
+ * characters, which views may contain, so step over those. */
+static
+bool corto_strview_icmpn(
+    const char *str1,
+    const char *str2,
+    size_t n)
+{
+    size_t i = 0;
+    while ((i += corto_simd_strimismatch(str1 + i, str2 + i, n - i)) < n) {
+        if (str1[i] || str2[i]) {
+            return false;
+        }
+        i ++;
+    }
+    return true;
+}
+
+bool corto_strview_iequals(
+    corto_strview str1,
+    corto_strview str2)
+{
+    return (str1.len == str2.len) &&
+        corto_strview_icmpn(str1.ptr, str2.ptr, str1.len);
+}
+
+bool corto_strview_iprefix(
+    corto_strview str,
+    corto_strview prefix)
+{
+    return (str.len >= prefix.len) &&
+        corto_strview_icmpn(str.ptr, prefix.ptr, prefix.len);
+}
+
+char* corto_strview_dup(
+    corto_strview str)
+{
+    char *result = corto_alloc(str.len + 1);
+    memcpy(result, str.ptr, str.len);
+    result[str.len] = '\0';
+    return result;
+}
+
+char* corto_strview_replace(
+    corto_strview str,
+    corto_strview replace,
+    corto_strview with)
+{
+    corto_strview remaining = str;
+    ptrdiff_t pos;
+    size_t count = 0;
+
+    if (!replace.len) {
+        return corto_strview_dup(str);
+    }
+
+    /* Count occurrences to compute the length of the result */
+    while ((pos = corto_strview_findstr(remaining, replace)) != -1) {
+        remaining = corto_strview_slice(remaining, pos + replace.len, SIZE_MAX);
+        count ++;
+    }
+
+    char *result = corto_alloc(str.len - count * replace.len + count * with.len + 1);
+    char *bptr = result;
+
+    remaining = str;
+    while (count --) {
+        pos = corto_strview_findstr(remaining, replace);
+        memcpy(bptr, remaining.ptr, pos);
+        bptr += pos;
+        memcpy(bptr, with.ptr, with.len);
+        bptr += with.len;
+        remaining = corto_strview_slice(remaining, pos + replace.len, SIZE_MAX);
+    }
+
+    memcpy(bptr, remaining.ptr, remaining.len);
+    bptr[remaining.len] = '\0';
+
+    return result;
+}
@@ -21,12 +21,18 @@
 
 #include <corto/platform.h>
 
+#ifdef CORTO_SEM_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 corto_thread corto_thread_new(corto_thread_cb f, void* arg) {
     pthread_t thread;
     int r;
 
     if ((r = pthread_create (&thread, NULL, f, arg))) {
-        corto_critical("pthread_create failed: %d", r);
+        corto_throw("pthread_create failed: %s", strerror(r));
+        return 0;
     }
 
     return (corto_thread)thread;
@@ -124,7 +130,16 @@ void corto_tls_free(void) {
 
 int corto_mutex_new(struct corto_mutex_s *m) {
     int result;
-    if ((result = pthread_mutex_init (&m->mutex, NULL))) {
+#ifdef CORTO_MUTEX_SPIN
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+    result = pthread_mutex_init (&m->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+#else
+    result = pthread_mutex_init (&m->mutex, NULL);
+#endif
+    if (result) {
         corto_throw("mutexNew failed: %s", strerror(result));
     }
     return result;
@@ -263,6 +278,107 @@ int corto_rwmutex_unlock(corto_rwmutex mutex) {
     return result;
 }
 
+#ifdef CORTO_SEM_FUTEX
+
+/* The value of a semaphore is the futex word. A thread only waits on the futex
+ * if the value is zero, after incrementing waiters. Posting increments the
+ * value, and only wakes a thread if waiters is not zero. Both are sequentially
+ * consistent, so either the poster sees the waiter, or the waiter sees the new
+ * value and the kernel doesn't put it to sleep. */
+
+static
+int corto_futex_wait(
+    int *addr,
+    int value)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static
+int corto_futex_wake(
+    int *addr,
+    int count)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+corto_sem corto_sem_new(unsigned int initValue) {
+    corto_sem semaphore;
+
+    semaphore = malloc (sizeof(corto_sem_s));
+    if (semaphore) {
+        semaphore->value = initValue;
+        semaphore->waiters = 0;
+    }
+
+    return (corto_sem)semaphore;
+}
+
+/* Post to semaphore */
+int corto_sem_post(corto_sem semaphore) {
+    __atomic_add_fetch(&semaphore->value, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&semaphore->waiters, __ATOMIC_SEQ_CST)) {
+        corto_futex_wake(&semaphore->value, 1);
+    }
+    return 0;
+}
+
+/* Wait for semaphore */
+int corto_sem_wait(corto_sem semaphore) {
+    int value = __atomic_load_n(&semaphore->value, __ATOMIC_RELAXED);
+
+    for (;;) {
+        while (value > 0) {
+            if (__atomic_compare_exchange_n(&semaphore->value, &value,
+                value - 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                return 0;
+            }
+        }
+
+        __atomic_add_fetch(&semaphore->waiters, 1, __ATOMIC_SEQ_CST);
+        if (corto_futex_wait(&semaphore->value, 0) &&
+            errno != EAGAIN && errno != EINTR)
+        {
+            __atomic_sub_fetch(&semaphore->waiters, 1, __ATOMIC_SEQ_CST);
+            corto_throw("semWait failed: %s", strerror(errno));
+            return -1;
+        }
+        __atomic_sub_fetch(&semaphore->waiters, 1, __ATOMIC_SEQ_CST);
+
+        value = __atomic_load_n(&semaphore->value, __ATOMIC_RELAXED);
+    }
+}
+
+/* Trywait for semaphore */
+int corto_sem_tryWait(corto_sem semaphore) {
+    int value = __atomic_load_n(&semaphore->value, __ATOMIC_RELAXED);
+
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(&semaphore->value, &value,
+            value - 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/* Get value of semaphore */
+int corto_sem_value(corto_sem semaphore) {
+    return __atomic_load_n(&semaphore->value, __ATOMIC_RELAXED);
+}
+
+/* Free semaphore */
+int corto_sem_free(corto_sem semaphore) {
+    free(semaphore);
+    return 0;
+}
+
+#else
+
 corto_sem corto_sem_new(unsigned int initValue) {
     corto_sem semaphore;
 
@@ -328,6 +444,8 @@ int corto_sem_free(corto_sem semaphore) {
     return 0;
 }
 
+#endif
+
 
 int corto_ainc(int* count) {
     int value;
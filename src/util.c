@@ -31,8 +31,13 @@ typedef struct corto_threadString_t {
 
 /* Set intern TLS string */
 char* corto_setThreadString(char* string) {
+    return corto_setThreadStringView(corto_strview_from(string));
+}
+
+/* Set intern TLS string from a string slice */
+char* corto_setThreadStringView(corto_strview string) {
     corto_threadString_t *data = corto_tls_get(CORTO_KEY_THREAD_STRING);
-    int32_t len = strlen(string);
+    int32_t len = string.len;
     int32_t max = 0;
 
     if (!data) {
@@ -47,13 +52,14 @@ char* corto_setThreadString(char* string) {
     if (data->strings[data->current] &&
        ((max < len) || (max > CORTO_MAX_TLS_STRINGS_MAX))) {
         corto_dealloc(data->strings[data->current]);
-        data->strings[data->current] = corto_strdup(string);
+        data->strings[data->current] = corto_strview_dup(string);
         data->max[data->current] = len;
     } else {
         if (data->strings[data->current]) {
-            strcpy(data->strings[data->current], string);
+            memcpy(data->strings[data->current], string.ptr, len);
+            data->strings[data->current][len] = '\0';
         } else {
-            data->strings[data->current] = corto_strdup(string);
+            data->strings[data->current] = corto_strview_dup(string);
             data->max[data->current] = len;
         }
     }
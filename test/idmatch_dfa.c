@@ -0,0 +1,251 @@
+/* Copyright (c) 2010-2018 the corto developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Differential test of idmatch programs against the interpreter as it was
+ * before programs were compiled to a DFA (idmatch_baseline.c). Every pattern
+ * is matched against every id, by the program that corto_idmatch_compile
+ * selects (DFA, specialized kind or interpreter), by the current interpreter
+ * and by the original interpreter. The current engines must always agree. The
+ * original interpreter must agree too, except for the pairs in divergences,
+ * which lists every intended change of behavior.
+ *
+ * Build and run from the root of the repository:
+ *   cc -std=gnu99 -D_GNU_SOURCE -DBUILDING_CORTO=1 -Iinclude -Isrc \
+ *       test/idmatch_dfa.c test/idmatch_baseline.c src/[a-z]*.c \
+ *       -lpthread -ldl -lm -o idmatch_dfa && ./idmatch_dfa
+ */
+
+#include <corto/platform.h>
+#include "idmatch.h"
+
+typedef struct baseline_idmatch_program_s* baseline_idmatch_program;
+
+baseline_idmatch_program baseline_idmatch_compile(
+    const char *expr,
+    bool allowScopes,
+    bool allowSeparators);
+
+bool baseline_idmatch_run(
+    baseline_idmatch_program program,
+    const char *str);
+
+void baseline_idmatch_free(
+    baseline_idmatch_program matcher);
+
+static const char *patterns[] = {
+    "a", "A", "*", "a*", "*b", "?", "a?b",
+    "a/b", "a/*", "*/b", "/a/b", "/a",
+    "a//b", "a//*", "//b", "//*", "*//b",
+    "a/b//c", "//a//b", "a//b//c",
+    "a/b,c", "a,b/c", "a/,b", "a//,b", "b/c,//x",
+    "a/b/..", "a/.",
+    NULL
+};
+
+static const char *ids[] = {
+    "a", "A", "b", "c", "ab", ".a", "/a",
+    "a/b", "A/B", "/a/b", "a/.b", "b/b", "x/a/b",
+    "a/b/b", "a/b/c", "a/c/b", "b/c/b",
+    "a/b/c/b", "a/b/c/c", "a/x/b/c",
+    NULL
+};
+
+typedef struct divergence {
+    const char *pattern;
+    const char *id;
+    bool result;            /* Result of the current engines */
+    bool baselineCrashes;   /* Original interpreter isn't run */
+} divergence;
+
+static divergence divergences[] = {
+    /* Identifiers and literal paths ignore a leading '/' in the pattern and
+     * in the id, as the general engine does. Before, "a" did not match "/a",
+     * and a pattern with a leading '/' compared the id against an empty
+     * identifier. */
+    {"a", "/a", true, false},
+    {"A", "/a", true, false},
+    {"/a", "a", true, false},
+    {"/a", "A", true, false},
+    {"/a", "/a", true, false},
+    {"a/b/..", "/a", true, false},
+    {"a/.", "/a", true, false},
+
+    /* The segment after the last '//' must end at the last element. Before,
+     * only the first run of matching elements was considered. */
+    {"a//b", "a/b/c/b", true, false},
+    {"//b", "b/c/b", true, false},
+    {"//b", "a/b/c/b", true, false},
+    {"*//b", "a/b/c/b", true, false},
+    {"//a//b", "a/b/c/b", true, false},
+
+    /* A '//' after a leading '//' searches from the element after the one on
+     * which the previous segment ended. Before, it searched from that element,
+     * so "//a//b" matched ids without an "a". */
+    {"//a//b", "b", false, false},
+    {"//a//b", "b/b", false, false},
+    {"//a//b", "b/c/b", false, false},
+
+    /* Alternatives separated by ',' are matched separately, each must match
+     * the whole id, and a leading '/' is ignored in every alternative. Before,
+     * elements matched by one alternative carried over to the next. */
+    {"a/b,c", "a/b", true, false},
+    {"a/b,c", "A/B", true, false},
+    {"a/b,c", "/a/b", true, false},
+    {"a/b,c", "c", true, false},
+    {"a,b/c", "a", true, false},
+    {"a,b/c", "A", true, false},
+    {"a,b/c", "/a", true, false},
+    {"a,b/c", "a/b", false, false},
+    {"a,b/c", "A/B", false, false},
+    {"a,b/c", "/a/b", false, false},
+    {"a,b/c", "a/.b", false, false},
+    {"b/c,//x", "b/c/b", false, false},
+
+    /* A '/' or '//' before ',' appends '*', as at the end of a pattern, and
+     * '*' doesn't match elements that start with '.'. */
+    {"a/,b", "b", true, false},
+    {"a/,b", "a/.b", false, false},
+    {"a//,b", "b", true, false},
+    {"a//,b", "a/.b", false, false},
+
+    /* Empty ids and "/" have no elements. The original interpreter read
+     * before the start of the element array for these. */
+    {"a//b", "", false, true},
+    {"a//b", "/", false, true},
+    {"//b", "", false, true},
+    {"a/b,c", "/", false, true},
+
+    {NULL}
+};
+
+static
+divergence* findDivergence(
+    const char *pattern,
+    const char *id)
+{
+    divergence *d;
+    for (d = divergences; d->pattern; d ++) {
+        if (!strcmp(d->pattern, pattern) && !strcmp(d->id, id)) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+static
+int checkPair(
+    const char *pattern,
+    const char *id,
+    uint32_t *engines)
+{
+    int errors = 0;
+    corto_idmatch_program program = corto_idmatch_compileFlags(pattern,
+        CORTO_IDMATCH_ALLOW_SCOPES | CORTO_IDMATCH_ALLOW_SEPARATORS);
+    corto_idmatch_program interp = corto_idmatch_compileFlags(pattern,
+        CORTO_IDMATCH_ALLOW_SCOPES | CORTO_IDMATCH_ALLOW_SEPARATORS |
+        CORTO_IDMATCH_NO_DFA);
+    divergence *d = findDivergence(pattern, id);
+    bool result, interpResult;
+
+    if (!program || !interp) {
+        printf("FAIL '%s': doesn't compile\n", pattern);
+        errors ++;
+        goto done;
+    }
+
+    result = corto_idmatch_run(program, id);
+    interpResult = corto_idmatch_run(interp, id);
+    engines[program->dfa ? 0 : program->kind ? 1 : 2] ++;
+
+    if (result != interpResult) {
+        printf("FAIL '%s' on '%s': %s %d, interpreter %d\n", pattern, id,
+            program->dfa ? "dfa" : "kind", result, interpResult);
+        errors ++;
+    }
+
+    if (d) {
+        if (result != d->result) {
+            printf("FAIL '%s' on '%s': %d, expected %d\n", pattern, id,
+                result, d->result);
+            errors ++;
+        }
+    }
+
+    if (!d || !d->baselineCrashes) {
+        baseline_idmatch_program baseline =
+            baseline_idmatch_compile(pattern, true, true);
+        bool baselineResult = baseline_idmatch_run(baseline, id);
+        baseline_idmatch_free(baseline);
+
+        if (!d && (result != baselineResult)) {
+            printf("FAIL '%s' on '%s': %d, original interpreter %d, and the "
+                "pair is not a divergence\n", pattern, id, result,
+                baselineResult);
+            errors ++;
+        } else if (d && (result == baselineResult)) {
+            printf("FAIL '%s' on '%s': divergence no longer differs from "
+                "original interpreter\n", pattern, id);
+            errors ++;
+        }
+    }
+
+done:
+    corto_idmatch_free(program);
+    corto_idmatch_free(interp);
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t engines[3] = {0}, checks = 0, p, i;
+    int errors = 0;
+    divergence *d;
+
+    platform_init(argv[0]);
+
+    for (p = 0; patterns[p]; p ++) {
+        for (i = 0; ids[i]; i ++) {
+            errors += checkPair(patterns[p], ids[i], engines);
+            checks ++;
+        }
+    }
+
+    /* Divergences for ids that are not in the corpus */
+    for (d = divergences; d->pattern; d ++) {
+        for (i = 0; ids[i]; i ++) {
+            if (!strcmp(d->id, ids[i])) {
+                break;
+            }
+        }
+        if (!ids[i]) {
+            errors += checkPair(d->pattern, d->id, engines);
+            checks ++;
+        }
+    }
+
+    printf("%u checks (dfa %u, specialized %u, interpreter %u), "
+        "%u divergences, %d errors\n",
+        checks, engines[0], engines[1], engines[2],
+        (uint32_t)(d - divergences), errors);
+
+    platform_deinit();
+
+    return errors != 0;
+}